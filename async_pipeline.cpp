@@ -0,0 +1,91 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdfloat>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "async_task.hpp"
+#include "thread_pool.hpp"
+#include "wordle_calculations.hpp"
+
+// wordle_precompute.cpp written as coroutines, every stage hops onto the pool and the slices get
+// scored concurrently through when_all without any thread blocking on them
+using Async::Task;
+
+Task<std::vector<std::string>> load_words(ThreadPool::ThreadPool &pool, std::string filename,
+                                          size_t expected_count) {
+    co_await pool.schedule();
+    co_return Wordle::parseWords(filename, expected_count);
+}
+
+// guesses [begin, end) against every answer, the same as getGuessScores
+Task<std::vector<Wordle::GuessScore>> score_guesses(ThreadPool::ThreadPool &pool, const Wordle::WordStore &answers,
+                                                    const std::vector<Wordle::Word> &guesses, int64_t begin,
+                                                    int64_t end) {
+    co_await pool.schedule();
+    std::vector<uint8_t> row(answers.size());
+    std::vector<Wordle::GuessScore> scores;
+    scores.reserve(end - begin);
+    for (int64_t i = begin; i < end; i++) {
+        Wordle::getPatterns(answers, guesses[i], row.data());
+        int64_t counts[Wordle::pattern_count] = {};
+        for (uint8_t pattern : row) counts[pattern]++;
+        scores.push_back(Wordle::scoreHistogram(counts, answers.size()));
+    }
+    co_return scores;
+}
+
+Task<void> write_output(ThreadPool::ThreadPool &pool, std::string filename, const std::vector<std::string> &words,
+                        const std::vector<Wordle::GuessScore> &scores) {
+    using std::float64_t;
+    co_await pool.schedule();
+    std::vector<std::pair<std::string, int64_t>> vect(scores.size());
+    for (size_t i = 0; i < scores.size(); i++) vect[i] = std::pair(words[i], scores[i].score);
+    std::sort(vect.begin(), vect.end(), [](auto &a, auto &b) { return b.second > a.second; });
+    std::ofstream file(filename);
+    file << std::fixed << std::setprecision(3);
+    for (auto const &[word, score] : vect) file << word << " " << score / (float64_t)scores.size() << "\n";
+}
+
+Task<std::vector<Wordle::GuessScore>> pipeline(ThreadPool::ThreadPool &pool) {
+    auto words = co_await load_words(pool, "wordle-nyt-words-14855.txt", 14855);
+    Wordle::WordStore answers(words);
+    auto guesses = Wordle::toWords(words);
+
+    const int64_t slice_size = 256;
+    std::vector<Task<std::vector<Wordle::GuessScore>>> slices;
+    for (int64_t begin = 0; begin < (int64_t)guesses.size(); begin += slice_size) {
+        int64_t end = std::min((int64_t)guesses.size(), begin + slice_size);
+        slices.push_back(score_guesses(pool, answers, guesses, begin, end));
+    }
+    auto slice_scores = co_await Async::when_all(std::move(slices));
+
+    std::vector<Wordle::GuessScore> scores;
+    scores.reserve(guesses.size());
+    for (auto &slice : slice_scores) scores.insert(scores.end(), slice.begin(), slice.end());
+    co_await write_output(pool, "wordle_async_output.txt", words, scores);
+    co_return scores;
+}
+
+int main(int argc, char const *argv[]) {
+    (void)argc;
+    (void)argv;
+
+    ThreadPool::ThreadPool pool;
+    auto start = std::chrono::steady_clock::now();
+    auto scores = Async::syncWait(pipeline(pool));
+    auto stop = std::chrono::steady_clock::now();
+    pool.stop();
+
+    auto expected = Wordle::parseScores("wordle_scores.txt", 14855);
+    bool matches = Wordle::getScoreValues(scores) == expected;
+    std::cout << "Async Pipeline: " << scores.size() << " guesses in ";
+    Timer::printTime(std::cout, start, stop);
+    std::cout << ", " << (matches ? "matches" : "does not match") << " wordle_scores.txt\n";
+
+    return matches ? 0 : 1;
+}
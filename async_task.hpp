@@ -0,0 +1,263 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <latch>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+// Coroutines on top of the pool, co_await pool.schedule() moves a coroutine onto a worker and
+// co_await on a Task runs it and picks up its result without blocking the thread
+namespace Async {
+template <typename T = void>
+class Task;
+
+// Resumes whoever awaited the task once it's done, straight from the finishing thread
+struct FinalAwaiter {
+    bool await_ready() const noexcept { return false; }
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+        std::coroutine_handle<> continuation = handle.promise().continuation;
+        return continuation ? continuation : std::noop_coroutine();
+    }
+    void await_resume() const noexcept {}
+};
+
+class PromiseBase {
+   public:
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+
+    // lazy, nothing runs until the task is awaited
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { this->exception = std::current_exception(); }
+};
+
+template <typename T>
+class Promise : public PromiseBase {
+   public:
+    std::optional<T> value;
+
+    Task<T> get_return_object();
+    template <typename U>
+    void return_value(U&& value) {
+        this->value.emplace(std::forward<U>(value));
+    }
+    T result() {
+        if (this->exception) std::rethrow_exception(this->exception);
+        return std::move(*this->value);
+    }
+};
+
+template <>
+class Promise<void> : public PromiseBase {
+   public:
+    Task<void> get_return_object();
+    void return_void() {}
+    void result() {
+        if (this->exception) std::rethrow_exception(this->exception);
+    }
+};
+
+// Move-only handle to a lazily started coroutine, awaiting it starts it and hands its result or
+// exception to the awaiting coroutine
+template <typename T>
+class Task {
+   public:
+    using promise_type = Promise<T>;
+
+   private:
+    std::coroutine_handle<promise_type> handle;
+
+   public:
+    Task() noexcept : handle(nullptr) {}
+    explicit Task(std::coroutine_handle<promise_type> handle) noexcept : handle(handle) {}
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this == &other) return *this;
+        if (this->handle) this->handle.destroy();
+        this->handle = std::exchange(other.handle, nullptr);
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() {
+        if (this->handle) this->handle.destroy();
+    }
+
+    auto operator co_await() noexcept {
+        struct Awaiter {
+            std::coroutine_handle<promise_type> handle;
+
+            bool await_ready() const noexcept { return !this->handle || this->handle.done(); }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+                this->handle.promise().continuation = caller;
+                return this->handle;
+            }
+            T await_resume() { return this->handle.promise().result(); }
+        };
+        return Awaiter{this->handle};
+    }
+};
+
+template <typename T>
+Task<T> Promise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+// Every child arrives once, whoever brings remaining to zero resumes the waiter or counts down done
+class JoinCounter {
+   public:
+    std::atomic<int64_t> remaining;
+    std::coroutine_handle<> waiter;
+    std::latch* done;
+
+    std::coroutine_handle<> arrive() noexcept {
+        if (--this->remaining != 0) return std::noop_coroutine();
+        if (this->done) {
+            this->done->count_down();
+            return std::noop_coroutine();
+        }
+        return this->waiter;
+    }
+};
+
+// Runs one child of when_all or syncWait and tells the counter once it's done, the child's result and
+// exception get stored by makeJoinTask so this never throws
+class JoinTask {
+   public:
+    struct promise_type {
+        JoinCounter* counter = nullptr;
+
+        JoinTask get_return_object() {
+            return JoinTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        auto final_suspend() noexcept {
+            struct Awaiter {
+                bool await_ready() const noexcept { return false; }
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                    return handle.promise().counter->arrive();
+                }
+                void await_resume() const noexcept {}
+            };
+            return Awaiter{};
+        }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+   private:
+    std::coroutine_handle<promise_type> handle;
+
+   public:
+    explicit JoinTask(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+    JoinTask(JoinTask&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    JoinTask(const JoinTask&) = delete;
+    JoinTask& operator=(const JoinTask&) = delete;
+    ~JoinTask() {
+        if (this->handle) this->handle.destroy();
+    }
+    void start(JoinCounter& counter) {
+        this->handle.promise().counter = &counter;
+        this->handle.resume();
+    }
+};
+
+template <typename T>
+JoinTask makeJoinTask(Task<T>& task, std::optional<T>& result, std::exception_ptr& exception) {
+    try {
+        result.emplace(co_await task);
+    } catch (...) {
+        exception = std::current_exception();
+    }
+}
+
+inline JoinTask makeJoinTask(Task<void>& task, std::exception_ptr& exception) {
+    try {
+        co_await task;
+    } catch (...) {
+        exception = std::current_exception();
+    }
+}
+
+// Starts every join on the awaiting thread, the counter starts one higher than the number of joins so
+// the waiter can't be resumed before all of them have been started
+class JoinAll {
+   private:
+    std::vector<JoinTask>& joins;
+    JoinCounter counter;
+
+   public:
+    JoinAll(std::vector<JoinTask>& joins) : joins(joins), counter{{0}, nullptr, nullptr} {}
+    bool await_ready() const noexcept { return this->joins.empty(); }
+    bool await_suspend(std::coroutine_handle<> waiter) {
+        this->counter.remaining = this->joins.size() + 1;
+        this->counter.waiter = waiter;
+        for (JoinTask& join : this->joins) join.start(this->counter);
+        return --this->counter.remaining != 0;
+    }
+    void await_resume() const noexcept {}
+};
+
+// Runs the tasks concurrently, they only run in parallel if they co_await pool.schedule() first.
+// The results come back in the same order, the first exception gets rethrown after all of them finish
+template <typename T>
+Task<std::vector<T>> when_all(std::vector<Task<T>> tasks) {
+    std::vector<std::optional<T>> results(tasks.size());
+    std::vector<std::exception_ptr> exceptions(tasks.size());
+    std::vector<JoinTask> joins;
+    joins.reserve(tasks.size());
+    for (size_t i = 0; i < tasks.size(); i++) joins.push_back(makeJoinTask(tasks[i], results[i], exceptions[i]));
+    co_await JoinAll(joins);
+    for (std::exception_ptr& exception : exceptions)
+        if (exception) std::rethrow_exception(exception);
+    std::vector<T> values;
+    values.reserve(results.size());
+    for (std::optional<T>& result : results) values.push_back(std::move(*result));
+    co_return values;
+}
+
+inline Task<void> when_all(std::vector<Task<void>> tasks) {
+    std::vector<std::exception_ptr> exceptions(tasks.size());
+    std::vector<JoinTask> joins;
+    joins.reserve(tasks.size());
+    for (size_t i = 0; i < tasks.size(); i++) joins.push_back(makeJoinTask(tasks[i], exceptions[i]));
+    co_await JoinAll(joins);
+    for (std::exception_ptr& exception : exceptions)
+        if (exception) std::rethrow_exception(exception);
+}
+
+// Blocks a thread that isn't a coroutine until the task is done, never call it from a worker of the pool
+// the task runs on
+template <typename T>
+T syncWait(Task<T> task) {
+    std::latch done(1);
+    JoinCounter counter{{1}, nullptr, &done};
+    std::exception_ptr exception;
+    if constexpr (std::is_void_v<T>) {
+        JoinTask join = makeJoinTask(task, exception);
+        join.start(counter);
+        done.wait();
+        if (exception) std::rethrow_exception(exception);
+    } else {
+        std::optional<T> result;
+        JoinTask join = makeJoinTask(task, result, exception);
+        join.start(counter);
+        done.wait();
+        if (exception) std::rethrow_exception(exception);
+        return std::move(*result);
+    }
+}
+}  // namespace Async
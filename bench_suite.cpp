@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <ranges>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "enigma_calculations.hpp"
+#include "thread_pool.hpp"
+#include "witness_calculations.hpp"
+#include "wordle_calculations.hpp"
+
+// make bench runs this, every result is printed and appended to bench_results.jsonl tagged with argv[1]
+// (the commit) so runs can be compared later
+std::vector<Benchmark::Result> results;
+
+void record(const Benchmark::Result &result) {
+    Benchmark::printResult(std::cout, result);
+    results.push_back(result);
+}
+
+// empty jobs through addJob one at a time and through one addJobs call
+void dispatch_throughput(ThreadPool::ThreadPool &pool, int64_t job_count) {
+    std::atomic<int64_t> counter{0};
+    auto job = [&counter](int64_t threadId) {
+        (void)threadId;
+        counter.fetch_add(1, std::memory_order_relaxed);
+    };
+    pool.start();
+    record(Benchmark::measure("dispatch_addjob", "ns/job", pool.getThreadCount(), [&]() {
+        auto start = std::chrono::steady_clock::now();
+        for (int64_t i = 0; i < job_count; i++) pool.addJob(job);
+        pool.wait();
+        return Benchmark::seconds(start, std::chrono::steady_clock::now()) * 1e9 / job_count;
+    }));
+    record(Benchmark::measure("dispatch_addjobs", "ns/job", pool.getThreadCount(), [&]() {
+        auto start = std::chrono::steady_clock::now();
+        pool.addJobs(std::views::iota((int64_t)0, job_count) | std::views::transform([&job](int64_t) { return job; }));
+        pool.wait();
+        return Benchmark::seconds(start, std::chrono::steady_clock::now()) * 1e9 / job_count;
+    }));
+}
+
+// addJob to the job starting, one job in flight at a time, every sample is the median of rounds
+void dispatch_latency(ThreadPool::ThreadPool &pool, int64_t rounds) {
+    pool.start();
+    std::vector<double> latencies(rounds);
+    record(Benchmark::measure("dispatch_latency", "ns", pool.getThreadCount(), [&]() {
+        for (int64_t i = 0; i < rounds; i++) {
+            auto submitted = std::chrono::steady_clock::now();
+            pool.addJob([&latencies, submitted, i](int64_t threadId) {
+                (void)threadId;
+                latencies[i] = Benchmark::seconds(submitted, std::chrono::steady_clock::now()) * 1e9;
+            });
+            pool.wait();
+        }
+        std::nth_element(latencies.begin(), latencies.begin() + rounds / 2, latencies.end());
+        return latencies[rounds / 2];
+    }));
+}
+
+// the same getGuessScores call on pools of 1, 2, 4 ... up to every hardware thread
+void thread_scaling(const std::vector<std::string> &words, int64_t guess_count) {
+    std::vector<std::string> guesses(words.begin(), words.begin() + guess_count);
+    int64_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int64_t> thread_counts;
+    for (int64_t threads = 1; threads < max_threads; threads *= 2) thread_counts.push_back(threads);
+    thread_counts.push_back(max_threads);
+    for (int64_t threads : thread_counts) {
+        ThreadPool::ThreadPool pool(threads);
+        pool.start();
+        record(Benchmark::measure("scaling_guess_scores", "ms", threads, [&]() {
+            auto start = std::chrono::steady_clock::now();
+            Benchmark::keep(Wordle::getGuessScores(words, guesses, pool));
+            return Benchmark::seconds(start, std::chrono::steady_clock::now()) * 1e3;
+        }, 5));
+        pool.stop();
+    }
+}
+
+// getPatterns for a batch of guesses against every word, single threaded
+void wordle_kernel(const std::vector<std::string> &words, int64_t guess_count) {
+    Wordle::WordStore answers(words);
+    auto guesses = Wordle::toWords(words);
+    std::vector<uint8_t> row(words.size());
+    record(Benchmark::measure("wordle_kernel", "ns/pair", 1, [&]() {
+        auto start = std::chrono::steady_clock::now();
+        for (int64_t i = 0; i < guess_count; i++) {
+            Wordle::getPatterns(answers, guesses[i], row.data());
+            Benchmark::keep(row[i]);
+        }
+        return Benchmark::seconds(start, std::chrono::steady_clock::now()) * 1e9 / (guess_count * words.size());
+    }));
+}
+
+// the whole guess x answer distribution that wordle_precompute does, on the full pool
+void wordle_distribution(ThreadPool::ThreadPool &pool, const std::vector<std::string> &words) {
+    pool.start();
+    double pairs = (double)words.size() * words.size();
+    record(Benchmark::measure("wordle_distribution", "Mpairs/s", pool.getThreadCount(), [&]() {
+        auto start = std::chrono::steady_clock::now();
+        Benchmark::keep(Wordle::getGuessScores(words, words, pool));
+        return pairs / Benchmark::seconds(start, std::chrono::steady_clock::now()) / 1e6;
+    }, 5));
+}
+
+// witness_count does one powerMod (plus up to s - 1 squarings) per base, the odd composites
+// near n_base keep the exponent size the same as false_witness_numbers.cpp. witness_kernel_wide is the
+// one base per 64 bit multiply path, for comparing against the vector lanes
+template <typename Count>
+void witness_kernel(const std::string &name, Count &&count, int64_t n_base, int64_t n_count) {
+    std::vector<int64_t> composites;
+    for (int64_t n = n_base | 1; (int64_t)composites.size() < n_count; n += 2) {
+        bool prime = true;
+        for (int64_t p = 3; p * p <= n && prime; p += 2) prime = n % p != 0;
+        if (!prime) composites.push_back(n);
+    }
+    // witness_count(counts, n) touches counts[1 .. n - 1]
+    std::vector<int64_t> counts(composites.back(), 0);
+    int64_t modexps = 0;
+    for (int64_t n : composites) modexps += n - 1;
+    record(Benchmark::measure(name, "ns/modexp", 1, [&]() {
+        auto start = std::chrono::steady_clock::now();
+        for (int64_t n : composites) count(counts, n);
+        Benchmark::keep(counts[1]);
+        return Benchmark::seconds(start, std::chrono::steady_clock::now()) * 1e9 / modexps;
+    }));
+}
+
+void enigma_throughput(int64_t length) {
+    std::mt19937 mt(0);
+    std::uniform_int_distribution<int> letter(0, 25);
+    std::string input(length, 'a');
+    for (char &c : input) c = 'a' + letter(mt);
+    record(Benchmark::measure("enigma_encode", "MB/s", 1, [&]() {
+        Enigma::EnigmaMachine machine;
+        machine.setEnigmaMachine();
+        auto start = std::chrono::steady_clock::now();
+        std::string output = machine.encodeString(input);
+        Benchmark::keep(output.data()[0]);
+        return length / Benchmark::seconds(start, std::chrono::steady_clock::now()) / 1e6;
+    }));
+}
+
+int main(int argc, char const *argv[]) {
+    std::string label = argc > 1 ? argv[1] : "unlabeled";
+
+    auto words = Wordle::parseWords("wordle-nyt-words-14855.txt", 14855);
+    ThreadPool::ThreadPool pool;
+    dispatch_throughput(pool, 200000);
+    dispatch_latency(pool, 1000);
+    wordle_distribution(pool, words);
+    pool.stop();
+    thread_scaling(words, 1000);
+    wordle_kernel(words, 200);
+    witness_kernel("witness_kernel", Witness::witness_count, 100000, 20);
+    witness_kernel("witness_kernel_wide", Witness::witness_count_wide, 100000, 20);
+    enigma_throughput(1 << 22);
+
+    std::ofstream file("bench_results.jsonl", std::ios::app);
+    for (const Benchmark::Result &result : results) Benchmark::writeJson(file, result, label);
+    return 0;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Repeated samples with a warm-up and a 95% confidence interval, results go out as one JSON object per line
+namespace Benchmark {
+struct Result {
+    std::string name;
+    std::string unit;
+    int64_t threads;
+    int64_t warmup;
+    std::vector<double> samples;
+    double mean;
+    double ci95;
+    double median;
+    double min;
+    double max;
+};
+
+// stops the compiler from throwing away a result that's never read
+template <typename T>
+void keep(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+inline double seconds(const std::chrono::steady_clock::time_point& start,
+                      const std::chrono::steady_clock::time_point& stop) {
+    return std::chrono::duration<double>(stop - start).count();
+}
+
+// two sided 95% Student t for n - 1 degrees of freedom
+inline double tValue(int64_t degrees) {
+    static const double table[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                   2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                   2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    if (degrees < 1) return 0;
+    if (degrees <= 30) return table[degrees - 1];
+    return 1.960;
+}
+
+Result summarize(const std::string& name, const std::string& unit, int64_t threads, int64_t warmup,
+                 std::vector<double> samples) {
+    Result result{name, unit, threads, warmup, samples, 0, 0, 0, 0, 0};
+    int64_t n = samples.size();
+    for (double sample : samples) result.mean += sample;
+    result.mean /= n;
+    double variance = 0;
+    for (double sample : samples) variance += (sample - result.mean) * (sample - result.mean);
+    if (n > 1) variance /= n - 1;
+    result.ci95 = tValue(n - 1) * std::sqrt(variance / n);
+    std::sort(samples.begin(), samples.end());
+    result.median = n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+    result.min = samples.front();
+    result.max = samples.back();
+    return result;
+}
+
+// sample() runs one timed round and returns the value to report. Warm-up rounds keep going until three in
+// a row land within 5% of each other (or maxWarmup runs out), then sampleCount rounds get kept
+template <typename Sample>
+Result measure(const std::string& name, const std::string& unit, int64_t threads, Sample&& sample,
+               int64_t sampleCount = 10, int64_t maxWarmup = 20) {
+    std::vector<double> warm;
+    while ((int64_t)warm.size() < maxWarmup) {
+        warm.push_back(sample());
+        if (warm.size() < 3) continue;
+        auto last = warm.end() - 3;
+        auto [low, high] = std::minmax_element(last, warm.end());
+        if (*high - *low <= 0.05 * std::abs(*high)) break;
+    }
+    std::vector<double> samples(sampleCount);
+    for (double& value : samples) value = sample();
+    return summarize(name, unit, threads, warm.size(), std::move(samples));
+}
+
+void printResult(std::ostream& stream, const Result& result) {
+    std::streamsize precision = stream.precision();
+    stream << std::left << std::setw(28) << result.name << std::right << std::setw(4) << result.threads << "t "
+           << std::setprecision(4) << std::setw(12) << result.mean << " +- " << std::setw(10) << result.ci95 << " "
+           << result.unit << " (median " << result.median << ", " << result.samples.size() << " samples after "
+           << result.warmup << " warm-up)\n";
+    stream << std::setprecision(precision);
+}
+
+void writeJson(std::ostream& stream, const Result& result, const std::string& label) {
+    std::streamsize precision = stream.precision();
+    stream << std::setprecision(10) << "{\"label\":\"" << label << "\",\"name\":\"" << result.name
+           << "\",\"unit\":\"" << result.unit << "\",\"threads\":" << result.threads << ",\"mean\":" << result.mean
+           << ",\"ci95\":" << result.ci95 << ",\"median\":" << result.median << ",\"min\":" << result.min
+           << ",\"max\":" << result.max << ",\"warmup\":" << result.warmup << ",\"samples\":[";
+    for (size_t i = 0; i < result.samples.size(); i++) stream << (i ? "," : "") << result.samples[i];
+    stream << "]}\n";
+    stream << std::setprecision(precision);
+}
+}  // namespace Benchmark
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <sched.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// Reads the cpu layout out of sysfs, root can point at a copy of /sys/devices/system/cpu for testing
+namespace Topology {
+struct Cpu {
+    int64_t id;
+    int64_t core;
+    int64_t package;
+    int64_t node;
+    // 0 for the first hardware thread of a core, 1 for its SMT sibling and so on
+    int64_t sibling;
+};
+
+// "0-3,8,10-11" style lists
+std::vector<int64_t> parseCpuList(const std::string& list) {
+    std::vector<int64_t> cpus;
+    std::stringstream stream(list);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        if (range.empty() || range == "\n") continue;
+        auto dash = range.find('-');
+        int64_t first = std::stoll(range.substr(0, dash));
+        int64_t last = dash == std::string::npos ? first : std::stoll(range.substr(dash + 1));
+        for (int64_t cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+int64_t readValue(const std::filesystem::path& path, int64_t fallback) {
+    std::ifstream file(path);
+    int64_t value;
+    if ((file >> value).fail()) return fallback;
+    return value;
+}
+
+// The ones out of ids this process is allowed to run on, all of them if the mask can't be read
+std::vector<int64_t> allowedCpus(const std::vector<int64_t>& ids) {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return ids;
+    std::vector<int64_t> result;
+    for (int64_t id : ids)
+        if (id < CPU_SETSIZE && CPU_ISSET(id, &allowed)) result.push_back(id);
+    return result;
+}
+
+std::vector<int64_t> onlineCpus(const std::filesystem::path& root) {
+    std::ifstream online_file(root / "online");
+    std::string online;
+    std::getline(online_file, online);
+    return parseCpuList(online);
+}
+
+// Only the online cpus in allowed, sorted so that cpus next to each other share a node, package and core.
+// Siblings get numbered after the filter so a core whose first thread is masked off still has a sibling 0
+std::vector<Cpu> detectTopology(const std::filesystem::path& root, const std::vector<int64_t>& allowed) {
+    std::vector<Cpu> cpus;
+    for (int64_t id : onlineCpus(root)) {
+        if (std::find(allowed.begin(), allowed.end(), id) == allowed.end()) continue;
+        std::filesystem::path cpu_dir = root / ("cpu" + std::to_string(id));
+        Cpu cpu{id, readValue(cpu_dir / "topology" / "core_id", id),
+                readValue(cpu_dir / "topology" / "physical_package_id", 0), 0, 0};
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator(cpu_dir, error)) {
+            std::string name = entry.path().filename();
+            if (name.starts_with("node") && name.size() > 4) cpu.node = std::stoll(name.substr(4));
+        }
+        cpus.push_back(cpu);
+    }
+    std::sort(cpus.begin(), cpus.end(), [](const Cpu& a, const Cpu& b) {
+        return std::tie(a.node, a.package, a.core, a.id) < std::tie(b.node, b.package, b.core, b.id);
+    });
+    for (size_t i = 1; i < cpus.size(); i++) {
+        const Cpu& prev = cpus[i - 1];
+        if (prev.node == cpus[i].node && prev.package == cpus[i].package && prev.core == cpus[i].core)
+            cpus[i].sibling = prev.sibling + 1;
+    }
+    return cpus;
+}
+
+// Everything this process is allowed to run on
+std::vector<Cpu> detectTopology(const std::filesystem::path& root = "/sys/devices/system/cpu") {
+    return detectTopology(root, allowedCpus(onlineCpus(root)));
+}
+
+// One hardware thread per core, cores of the same socket stay next to each other
+std::vector<int64_t> physicalCores(const std::vector<Cpu>& cpus) {
+    std::vector<int64_t> result;
+    for (const Cpu& cpu : cpus)
+        if (cpu.sibling == 0) result.push_back(cpu.id);
+    return result;
+}
+
+// Every core's first thread before any SMT sibling, so a smaller pool still gets whole cores
+std::vector<int64_t> allCpus(const std::vector<Cpu>& cpus) {
+    std::vector<Cpu> ordered = cpus;
+    std::stable_sort(ordered.begin(), ordered.end(), [](const Cpu& a, const Cpu& b) { return a.sibling < b.sibling; });
+    std::vector<int64_t> result;
+    for (const Cpu& cpu : ordered) result.push_back(cpu.id);
+    return result;
+}
+}  // namespace Topology
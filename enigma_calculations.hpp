@@ -1,6 +1,12 @@
+#pragma once
+
 #include <algorithm>
+#include <cassert>
+#include <cstdint>
 #include <limits>
+#include <numeric>
 #include <random>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -19,68 +25,112 @@ bool hasSelfMap(const std::vector<int>& shuffle_arr) {
     return std::any_of(shuffle_arr.begin(), shuffle_arr.end(), [idx = 0](int val) mutable { return val == idx++; });
 }
 
+// Pairs every letter up with a different one, so a reflector never maps a letter to itself
 void generateReflectorMap(std::mt19937& mt, std::vector<int>& vect, size_t vect_size) {
-    // TODO
+    assert(vect_size % 2 == 0);
+    std::vector<int> order(vect_size);
+    generateMap(mt, order);
+    vect.resize(vect_size);
+    std::iota(vect.begin(), vect.end(), 0);
+    for (size_t i = 0; i + 1 < vect_size; i += 2) std::swap(vect[order[i]], vect[order[i + 1]]);
 }
 
+// plug_count swapped pairs, every other letter goes through unchanged
 void generatePlugboardMap(std::mt19937& mt, std::vector<int>& vect, size_t vect_size, int plug_count) {
-    // TODO
+    assert(plug_count >= 0 && 2 * (size_t)plug_count <= vect_size);
+    std::vector<int> order(vect_size);
+    generateMap(mt, order);
+    vect.resize(vect_size);
+    std::iota(vect.begin(), vect.end(), 0);
+    for (size_t i = 0; i < (size_t)plug_count; i++) std::swap(vect[order[2 * i]], vect[order[2 * i + 1]]);
 }
 
+// The maps are also kept as a table per offset, table[offset * rotor_size + input] is the encoded value at that
+// offset, so a letter is one lookup instead of two divisions
 class Rotor {
    private:
     std::vector<int64_t> forward_map;
     std::vector<int64_t> backward_map;
+    std::vector<uint8_t> forward_table;
+    std::vector<uint8_t> backward_table;
     size_t offset;
 
    public:
-    Rotor() : forward_map(rotor_size), backward_map(rotor_size), offset{0} {}
+    Rotor()
+        : forward_map(rotor_size),
+          backward_map(rotor_size),
+          forward_table(rotor_size * rotor_size),
+          backward_table(rotor_size * rotor_size),
+          offset{0} {}
     ~Rotor() {}
     void setRotor(const std::vector<int64_t>& the_map) {
         for (size_t i = 0; i < rotor_size; i++) {
             forward_map[i] = the_map[i] - i;
             backward_map[the_map[i]] = i - the_map[i];
         }
+        for (size_t o = 0; o < rotor_size; o++) {
+            for (size_t i = 0; i < rotor_size; i++) {
+                forward_table[o * rotor_size + i] = (i + forward_map[(i + o) % rotor_size] + rotor_size) % rotor_size;
+                backward_table[o * rotor_size + i] = (i + backward_map[(i + o) % rotor_size] + rotor_size) % rotor_size;
+            }
+        }
     }
     void setOffset(size_t the_offset) { offset = the_offset; }
+    // anything that isn't a letter only ever comes in here from the plugboard, it wraps around like it always did
     int64_t forwardEncodeVal(int64_t input) {
+        if ((uint64_t)input < rotor_size) return forward_table[offset * rotor_size + input];
         return (input + forward_map[(input + offset) % rotor_size] + rotor_size) % rotor_size;
     }
-    int64_t backwardEncodeVal(int64_t input) {
-        return (input + backward_map[(input + offset) % rotor_size] + rotor_size) % rotor_size;
+    int64_t backwardEncodeVal(int64_t input) { return backward_table[offset * rotor_size + input]; }
+    bool increment() {
+        offset = offset + 1 == rotor_size ? 0 : offset + 1;
+        return offset == 0;
     }
-    bool increment() { return 0 == (offset = (offset + 1) % rotor_size); }
 };
 
 class Rotorboard {
    private:
     std::vector<Rotor> rotors;
     Rotor reflector;
+    // every rotor past the first, the reflector and back again for their current offsets, those only
+    // move once every rotor_size letters so it gets rebuilt then instead of walked every letter
+    std::vector<uint8_t> inner;
+
+    void buildInner() {
+        for (size_t v = 0; v < rotor_size; v++) {
+            int64_t val = v;
+            for (size_t i = 1; i < rotor_count; i++) val = rotors[i].forwardEncodeVal(val);
+            val = reflector.forwardEncodeVal(val);
+            for (size_t i = rotor_count; i > 1; i--) val = rotors[i - 1].backwardEncodeVal(val);
+            inner[v] = val;
+        }
+    }
 
    public:
-    Rotorboard() : rotors(rotor_count), reflector() {}
+    Rotorboard() : rotors(rotor_count), reflector(), inner(rotor_size) { buildInner(); }
     ~Rotorboard() {}
     void setRotorboard(const std::vector<std::vector<int64_t>>& the_map) {
         for (size_t i = 0; i < rotor_count; i++) {
             rotors[i].setRotor(the_map[i]);
         }
+        buildInner();
+    }
+    void setReflector(const std::vector<int64_t>& the_map) {
+        reflector.setRotor(the_map);
+        buildInner();
     }
-    void setReflector(const std::vector<int64_t>& the_map) { reflector.setRotor(the_map); }
     int64_t encodeVal(int64_t val) {
-        for (size_t i = 0; i < rotor_count; i++) {
-            val = rotors[i].forwardEncodeVal(val);
-        }
-        val = reflector.forwardEncodeVal(val);
-        for (size_t i = rotor_count; i > 0; i--) {
-            val = rotors[i - 1].backwardEncodeVal(val);
-        }
-        return val;
+        val = rotors[0].forwardEncodeVal(val);
+        val = inner[val];
+        return rotors[0].backwardEncodeVal(val);
     }
     bool increment() {
+        if (!rotors[0].increment()) return false;
         bool did_rollover = true;
-        for (size_t i = 0; i < rotor_count; i++) {
+        for (size_t i = 1; i < rotor_count; i++) {
             if (did_rollover) did_rollover = rotors[i].increment();
         }
+        buildInner();
         return did_rollover;
     }
 };
@@ -111,8 +161,8 @@ class EnigmaMachine {
         return val;
     }
     std::string encodeString(const std::string& str) {
-        std::string new_str = "";
-        for (char c : str) new_str += 'a' + encodeVal(c - 'a');
+        std::string new_str(str.size(), 'a');
+        for (size_t i = 0; i < str.size(); i++) new_str[i] = 'a' + encodeVal(str[i] - 'a');
         return new_str;
     }
 };
@@ -1,13 +1,38 @@
 #include <algorithm>
+#include <cassert>
 #include <iostream>
 #include <random>
 #include <vector>
 
 #include "enigma_calculations.hpp"
 
+// both maps have to be involutions, swapping a pair twice gets the letter back
+void test_code() {
+    std::mt19937 mt(0);
+    for (int64_t trial = 0; trial < 100; trial++) {
+        std::vector<int> reflector;
+        Enigma::generateReflectorMap(mt, reflector, Enigma::rotor_size);
+        assert(reflector.size() == Enigma::rotor_size);
+        assert(!Enigma::hasSelfMap(reflector));
+        for (size_t i = 0; i < reflector.size(); i++) assert(reflector[reflector[i]] == (int)i);
+
+        int plug_count = trial % (Enigma::rotor_size / 2 + 1);
+        std::vector<int> plugboard;
+        Enigma::generatePlugboardMap(mt, plugboard, Enigma::rotor_size, plug_count);
+        assert(plugboard.size() == Enigma::rotor_size);
+        int64_t swapped = 0;
+        for (size_t i = 0; i < plugboard.size(); i++) {
+            assert(plugboard[plugboard[i]] == (int)i);
+            swapped += plugboard[i] != (int)i;
+        }
+        assert(swapped == 2 * plug_count);
+    }
+}
+
 int main(int argc, char const *argv[]) {
     (void)argc;
     (void)argv;
+    test_code();
     std::random_device rd;
     std::mt19937 mt(123456);
     std::string input;
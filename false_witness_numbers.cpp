@@ -1,11 +1,14 @@
 #include <algorithm>
 #include <cassert>
+#include <cstdio>
 #include <fstream>
 #include <iostream>
+#include <random>
+#include <string>
 #include <set>
-#include <utility>
 #include <vector>
 
+#include "result_writer.hpp"
 #include "thread_pool.hpp"
 #include "witness_calculations.hpp"
 
@@ -19,34 +22,143 @@ void test_code() {
         if (vect[i] == 1) assert(false_witnesses.find(vect[i]) != false_witnesses.end());
     }
 
-    auto primes = Witness::primeSieve(100);
-    std::set<int64_t> the_primes(
+    // Montgomery against the plain 128 bit path, including moduli way past where int64_t products overflow
+    std::mt19937_64 mt(0);
+    for (int64_t trial = 0; trial < 1000; trial++) {
+        int64_t n = (mt() >> (1 + trial % 60)) | 3;
+        Witness::Montgomery mont(n);
+        int64_t x = mt() % n, e = mt() % n + 1;
+        assert((int64_t)mont.fromMontgomery(mont.toMontgomery(x)) == x);
+        assert((int64_t)mont.fromMontgomery(mont.power(mont.toMontgomery(x), e)) == Witness::powerMod(x, e, n));
+    }
+    for (int64_t n : {9, 15, 91, 561, 1105, 4033, 8911}) {
+        std::vector<int64_t> fast(n, 0), wide(n, 0);
+        Witness::witness_count(fast, n);
+        Witness::witness_count_wide(wide, n);
+        int64_t d = n - 1;
+        int64_t s = Witness::remove_twos(d);
+        for (int64_t a = 1; a < n; a++) assert(fast[a] == Witness::is_false_witness(a, s, d, n));
+        assert(wide == fast);
+    }
+    // every lane of witnessMask against the plain test, odd moduli all the way up to 2^31
+    for (int64_t trial = 0; trial < 1000; trial++) {
+        int64_t n = (mt() >> (33 + trial % 28)) | 3;
+        Witness::Montgomery32 mont(n);
+        int64_t first = mt() % n;
+        assert((int64_t)mont.fromMontgomery(mont.toMontgomery(first)) == first);
+        int64_t d = n - 1;
+        int64_t s = Witness::remove_twos(d);
+        uint64_t a = mont.toMontgomery(first);
+        uint64_t mask = mont.witnessMask<16>(a, s, d);
+        for (int64_t l = 0; l < 16; l++) {
+            int64_t base = (first + l) % n;
+            if (base != 0) assert((bool)((mask >> l) & 1) == Witness::is_false_witness(base, s, d, n));
+        }
+        assert(a == mont.toMontgomery(first + 16));
+    }
+
+    ThreadPool::ThreadPool pool;
+    auto primes = Witness::primeSieve(100, pool);
+    std::vector<int64_t> the_primes(
         {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61, 67, 71, 73, 79, 83, 89, 97});
-    assert(primes == the_primes);
+    assert(primes.toVector() == the_primes);
+    for (int64_t i = -1; i < 101; i++)
+        assert(primes.isPrime(i) == std::binary_search(the_primes.begin(), the_primes.end(), i));
+    // several segments with a ragged last one, checked against trial division
+    const int64_t big = 3 * Witness::segment_bits + 12345;
+    auto big_primes = Witness::primeSieve(big, pool);
+    for (int64_t i = 0; i < big; i++) {
+        bool prime = i > 1;
+        for (int64_t p = 2; p * p <= i && prime; p++) prime = i % p != 0;
+        assert(big_primes.isPrime(i) == prime);
+    }
+    assert(Witness::primeCount(10000000, pool) == 664579);
+    assert(Witness::primeCount(big, pool) == big_primes.count());
+    pool.stop();
+
+    // orderByValue and TopK against a plain sort on the same ordering
+    std::vector<int64_t> values(5000);
+    for (int64_t &value : values) value = mt() % 50;
+    std::vector<ResultWriter::Record> records(values.size());
+    for (size_t i = 0; i < values.size(); i++) records[i] = {(int64_t)i, values[i]};
+    auto better = [](const ResultWriter::Record &a, const ResultWriter::Record &b) {
+        return a.value != b.value ? a.value > b.value : a.key < b.key;
+    };
+    std::sort(records.begin(), records.end(), better);
+    auto order = ResultWriter::orderByValue(values);
+    for (size_t i = 0; i < records.size(); i++) assert(order[i] == records[i].key);
+    ResultWriter::TopK<ResultWriter::Record, decltype(better)> top(100, better);
+    for (size_t i = 0; i < values.size(); i++) top.push({(int64_t)i, values[i]});
+    auto top_records = top.sorted();
+    assert(top_records.size() == 100);
+    for (size_t i = 0; i < top_records.size(); i++) assert(top_records[i].key == records[i].key);
+
+    // both formats written with buffers small enough to go through the writer thread many times
+    {
+        ResultWriter::RecordWriter text("witness_test.txt", ResultWriter::TEXT_FORMAT, records.size(), 512);
+        ResultWriter::RecordWriter binary("witness_test.bin", ResultWriter::BINARY_FORMAT, records.size(), 512);
+        for (const ResultWriter::Record &record : records) {
+            text.write(record);
+            binary.write(record);
+        }
+    }
+    std::ifstream text_file("witness_test.txt");
+    MatrixFile::MappedMatrix<int64_t> binary_file("witness_test.bin");
+    assert(binary_file.isValid() && binary_file.rows() == records.size() && binary_file.cols() == 2);
+    for (size_t i = 0; i < records.size(); i++) {
+        int64_t key, value;
+        text_file >> key >> value;
+        assert(key == records[i].key && value == records[i].value);
+        assert(binary_file(i, 0) == records[i].key && binary_file(i, 1) == records[i].value);
+    }
+    std::remove("witness_test.txt");
+    std::remove("witness_test.bin");
 }
 
 int main(int argc, char const *argv[]) {
-    (void)argc;
-    (void)argv;
     test_code();
 
-    const int64_t max_val = 100000;
-    auto primes = Witness::primeSieve(max_val);
-    std::vector<int64_t> vect(max_val, 0);
-    for (int64_t i = 3; i < max_val; i += 2) {
-        if (primes.find(i) != primes.end()) continue;
-        Witness::witness_count(vect, i);
-    }
-
-    std::vector<std::pair<int64_t, int64_t>> vect2(max_val);
-    for (int64_t i = 0; i < max_val; i++) {
-        vect2[i] = std::pair(i, vect[i]);
+    // false_witness_numbers.out [max_val] [--top k] [--binary]
+    // the census is quadratic, every odd composite n tries all n - 1 bases
+    const int64_t max_val = argc > 1 ? std::stoll(argv[1]) : 100000;
+    int64_t top_k = 0;
+    ResultWriter::FORMAT format = ResultWriter::TEXT_FORMAT;
+    for (int64_t i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--top" && i + 1 < argc) top_k = std::stoll(argv[++i]);
+        if (arg == "--binary") format = ResultWriter::BINARY_FORMAT;
     }
-    std::sort(vect2.begin(), vect2.end(), [](auto &a, auto &b) { return b.second < a.second; });
+    ThreadPool::ThreadPool pool;
+    auto primes = Witness::primeSieve(max_val, pool);
+    // odd i = 2k + 1 for k in [1, max_val / 2)
+    auto vect = pool.parallel_reduce(
+        1, max_val / 2, std::vector<int64_t>(max_val, 0),
+        [&primes](std::vector<int64_t> &counts, int64_t k) {
+            int64_t i = 2 * k + 1;
+            if (primes.isPrime(i)) return;
+            Witness::witness_count(counts, i);
+        },
+        [](std::vector<int64_t> counts, const std::vector<int64_t> &other) {
+            for (size_t i = 0; i < counts.size(); i++) counts[i] += other[i];
+            return counts;
+        },
+        16);
+    pool.stop();
 
-    std::ofstream file("witness_output.txt");
-    for (int64_t i = 0; i < max_val; i++) {
-        file << vect2[i].first << " " << vect2[i].second << "\n";
+    // most false witnesses first, ties smallest base first
+    std::string filename = format == ResultWriter::BINARY_FORMAT ? "witness_output.bin" : "witness_output.txt";
+    if (top_k > 0) {
+        auto better = [](const ResultWriter::Record &a, const ResultWriter::Record &b) {
+            return a.value != b.value ? a.value > b.value : a.key < b.key;
+        };
+        ResultWriter::TopK<ResultWriter::Record, decltype(better)> top(top_k, better);
+        for (int64_t i = 0; i < max_val; i++) top.push({i, vect[i]});
+        auto records = top.sorted();
+        ResultWriter::RecordWriter writer(filename, format, records.size());
+        for (const ResultWriter::Record &record : records) writer.write(record);
+    } else {
+        ResultWriter::RecordWriter writer(filename, format, max_val);
+        for (int64_t i : ResultWriter::orderByValue(vect)) writer.write(i, vect[i]);
     }
 
     return 0;
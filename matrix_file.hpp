@@ -0,0 +1,147 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Little endian binary matrices, a 64 byte header followed by rows * cols values in row-major order
+namespace MatrixFile {
+const char magic[8] = {'T', 'P', 'M', 'A', 'T', 'R', 'I', 'X'};
+const uint32_t version = 1;
+
+enum DTYPE : uint32_t { UINT8 = 1, UINT16 = 2, UINT32 = 3, INT64 = 4 };
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t dtype;
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t words_checksum;
+    uint64_t reserved[3];
+};
+static_assert(sizeof(Header) == 64);
+
+template <typename T>
+constexpr DTYPE dtypeOf() {
+    static_assert(std::is_same_v<T, uint8_t> || std::is_same_v<T, uint16_t> || std::is_same_v<T, uint32_t> ||
+                      std::is_same_v<T, int64_t>,
+                  "unsupported matrix type");
+    if constexpr (std::is_same_v<T, uint8_t>) return UINT8;
+    if constexpr (std::is_same_v<T, uint16_t>) return UINT16;
+    if constexpr (std::is_same_v<T, uint32_t>) return UINT32;
+    return INT64;
+}
+
+// FNV-1a over the words and their separators, so a file can't be read against a different word list
+uint64_t wordsChecksum(const std::vector<std::string>& words) {
+    uint64_t hash = 14695981039346656037ull;
+    for (const std::string& word : words) {
+        for (char c : word) hash = (hash ^ (uint8_t)c) * 1099511628211ull;
+        hash = (hash ^ (uint8_t)'\n') * 1099511628211ull;
+    }
+    return hash;
+}
+
+template <typename T>
+Header makeHeader(uint64_t rows, uint64_t cols, uint64_t words_checksum) {
+    Header header{};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.dtype = dtypeOf<T>();
+    header.rows = rows;
+    header.cols = cols;
+    header.words_checksum = words_checksum;
+    return header;
+}
+
+// Rows get appended one at a time so the whole matrix never has to be in memory
+template <typename T>
+class MatrixWriter {
+   private:
+    std::ofstream file;
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t rows_written;
+
+   public:
+    MatrixWriter(const std::string& filename, uint64_t rows, uint64_t cols, uint64_t words_checksum)
+        : file(filename, std::ios::binary | std::ios::trunc), rows(rows), cols(cols), rows_written(0) {
+        Header header = makeHeader<T>(rows, cols, words_checksum);
+        file.write((const char*)&header, sizeof(header));
+    }
+    ~MatrixWriter() { assert(rows_written == rows); }
+    void writeRow(const T* row) {
+        assert(rows_written < rows);
+        file.write((const char*)row, cols * sizeof(T));
+        rows_written++;
+    }
+    // flushes what's still buffered, check good() after it since that's where a full disk shows up
+    void close() { file.close(); }
+    bool good() const { return file.good(); }
+};
+
+// false when any of it didn't make it to the file
+template <typename T>
+bool writeMatrix(const std::string& filename, uint64_t rows, uint64_t cols, const T* data, uint64_t words_checksum) {
+    MatrixWriter<T> writer(filename, rows, cols, words_checksum);
+    bool good = writer.good();
+    for (uint64_t i = 0; i < rows; i++) {
+        writer.writeRow(data + i * cols);
+        good = good && writer.good();
+    }
+    writer.close();
+    return good && writer.good();
+}
+
+// Read only mmap of a matrix file, pages only get loaded when they're touched
+template <typename T>
+class MappedMatrix {
+   private:
+    void* mapping;
+    size_t mapping_size;
+    const Header* header;
+    const T* data;
+
+   public:
+    MappedMatrix(const std::string& filename) : mapping(MAP_FAILED), mapping_size(0), header(nullptr), data(nullptr) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(Header)) {
+            mapping_size = info.st_size;
+            mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (mapping == MAP_FAILED) return;
+        const Header* file_header = (const Header*)mapping;
+        if (std::memcmp(file_header->magic, magic, sizeof(magic)) != 0) return;
+        if (file_header->version != version || file_header->dtype != dtypeOf<T>()) return;
+        if (mapping_size != sizeof(Header) + file_header->rows * file_header->cols * sizeof(T)) return;
+        header = file_header;
+        data = (const T*)((const char*)mapping + sizeof(Header));
+    }
+    MappedMatrix(const MappedMatrix&) = delete;
+    MappedMatrix& operator=(const MappedMatrix&) = delete;
+    ~MappedMatrix() {
+        if (mapping != MAP_FAILED) munmap(mapping, mapping_size);
+    }
+    bool isValid() const { return header != nullptr; }
+    bool matches(const std::vector<std::string>& words) const {
+        return isValid() && header->words_checksum == wordsChecksum(words);
+    }
+    uint64_t rows() const { return header->rows; }
+    uint64_t cols() const { return header->cols; }
+    T operator()(uint64_t i, uint64_t j) const { return data[i * header->cols + j]; }
+    const T* row(uint64_t i) const { return data + i * header->cols; }
+};
+}  // namespace MatrixFile
@@ -0,0 +1,258 @@
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cpu_topology.hpp"
+#include "thread_pool.hpp"
+#include "wordle_calculations.hpp"
+
+// count every heap allocation so the steady state of the job queues can be checked
+std::atomic<int64_t> allocations{0};
+
+void *operator new(size_t size) {
+    allocations++;
+    if (void *ptr = std::malloc(size)) return ptr;
+    throw std::bad_alloc();
+}
+// kept out of line, gcc 12 inlines the free() next to a new expression and calls it mismatched-new-delete
+[[gnu::noinline]] void operator delete(void *ptr) noexcept { std::free(ptr); }
+[[gnu::noinline]] void operator delete(void *ptr, size_t size) noexcept {
+    (void)size;
+    std::free(ptr);
+}
+
+// random_sleep.cpp but with jobs short enough that dispatch is the bottleneck
+void short_jobs(ThreadPool::ThreadPool &pool, int64_t job_count) {
+    std::atomic<int64_t> counter{0};
+    auto start = std::chrono::steady_clock::now();
+    for (int64_t i = 0; i < job_count; i++) {
+        pool.addJob([&counter, i](int64_t threadId) {
+            (void)threadId;
+            std::mt19937 mt(i);
+            std::uniform_int_distribution<int> dist(0, 9);
+            int64_t spin = 100 * dist(mt);
+            int64_t val = 0;
+            for (int64_t j = 0; j < spin; j++) val += j * j;
+            counter += val & 1;
+        });
+    }
+    pool.start();
+    pool.wait();
+    auto stop = std::chrono::steady_clock::now();
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count();
+    std::cout << "Short Jobs: " << job_count << " jobs in ";
+    Timer::printTime(std::cout, start, stop);
+    std::cout << " (" << ns / job_count << " ns/job)\n";
+}
+
+// closures bigger than std::function's small buffer, after the first round the queues shouldn't allocate
+void tiny_jobs(ThreadPool::ThreadPool &pool, int64_t job_count, int64_t rounds) {
+    std::atomic<int64_t> counter{0};
+    std::array<int64_t, 8> payload{1, 2, 3, 4, 5, 6, 7, 8};
+    pool.start();
+    int64_t steady_allocations = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int64_t round = 0; round < rounds; round++) {
+        int64_t before = allocations;
+        for (int64_t i = 0; i < job_count; i++) {
+            pool.addJob([&counter, payload](int64_t threadId) {
+                (void)threadId;
+                counter += payload[7];
+            });
+        }
+        pool.wait();
+        if (round != 0) steady_allocations += allocations - before;
+    }
+    auto stop = std::chrono::steady_clock::now();
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count();
+    std::cout << "Tiny Jobs: " << job_count * rounds << " jobs in ";
+    Timer::printTime(std::cout, start, stop);
+    std::cout << " (" << ns / (job_count * rounds) << " ns/job, " << steady_allocations
+              << " allocations after the first round)\n";
+}
+
+// same jobs through addJob one at a time and through one addJobs call, with the pool already running
+void batch_jobs(ThreadPool::ThreadPool &pool, int64_t job_count) {
+    std::atomic<int64_t> counter{0};
+    auto job = [&counter](int64_t threadId) {
+        (void)threadId;
+        counter++;
+    };
+    pool.start();
+
+    auto start = std::chrono::steady_clock::now();
+    for (int64_t i = 0; i < job_count; i++) pool.addJob(job);
+    pool.wait();
+    auto middle = std::chrono::steady_clock::now();
+    pool.addJobs(std::views::iota((int64_t)0, job_count) | std::views::transform([&job](int64_t) { return job; }));
+    pool.wait();
+    auto stop = std::chrono::steady_clock::now();
+
+    std::cout << "Single Jobs: " << job_count << " jobs in ";
+    Timer::printTime(std::cout, start, middle);
+    std::cout << "\nBatch Jobs: " << job_count << " jobs in ";
+    Timer::printTime(std::cout, middle, stop);
+    std::cout << "\n";
+}
+
+// one job at a time with a gap in between so the workers go idle, reports how long a job takes to start
+// and how much cpu the process burned while waiting for it
+void idle_latency(ThreadPool::ThreadPool &pool, const std::string &name, const ThreadPool::IdlePolicy &policy,
+                  int64_t rounds) {
+    pool.stop();
+    pool.setIdlePolicy(policy);
+    pool.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    std::vector<int64_t> latencies(rounds);
+    rusage usage_start, usage_stop;
+    getrusage(RUSAGE_SELF, &usage_start);
+    auto start = std::chrono::steady_clock::now();
+    for (int64_t i = 0; i < rounds; i++) {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        auto submitted = std::chrono::steady_clock::now();
+        pool.addJob([&latencies, submitted, i](int64_t threadId) {
+            (void)threadId;
+            auto started = std::chrono::steady_clock::now();
+            latencies[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(started - submitted).count();
+        });
+        pool.wait();
+    }
+    auto stop = std::chrono::steady_clock::now();
+    getrusage(RUSAGE_SELF, &usage_stop);
+
+    auto cpu_us = [](const rusage &usage) {
+        return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 + usage.ru_utime.tv_usec +
+               usage.ru_stime.tv_usec;
+    };
+    auto wall_us = std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count();
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << "Idle " << name << ": p50 " << latencies[rounds / 2] << " ns, p99 " << latencies[rounds * 99 / 100]
+              << " ns, cpu " << 100 * (cpu_us(usage_stop) - cpu_us(usage_start)) / wall_us << "%\n";
+}
+
+void wordle_jobs(ThreadPool::ThreadPool &pool, size_t word_count) {
+    auto words = Wordle::parseWords("wordle-nyt-words-14855.txt", 14855);
+    words.resize(word_count);
+    auto start = std::chrono::steady_clock::now();
+    auto dist = Wordle::getWordDistribution(words, words, pool);
+    auto stop = std::chrono::steady_clock::now();
+    std::cout << "Wordle Jobs: " << word_count << " words in ";
+    Timer::printTime(std::cout, start, stop);
+    std::cout << "\n";
+}
+
+// A fake sysfs tree with 2 sockets (one NUMA node each) of 2 cores with 2 hardware threads, cpu i and
+// cpu i + 4 share a core the way Linux usually numbers them
+void test_topology() {
+    std::filesystem::path root = std::filesystem::temp_directory_path() / "pool_benchmark_topology_test";
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(root);
+    std::ofstream(root / "online") << "0-7\n";
+    for (int64_t id = 0; id < 8; id++) {
+        std::filesystem::path cpu_dir = root / ("cpu" + std::to_string(id));
+        std::filesystem::create_directories(cpu_dir / "topology");
+        std::filesystem::create_directories(cpu_dir / ("node" + std::to_string(id % 4 / 2)));
+        std::ofstream(cpu_dir / "topology" / "core_id") << id % 2 << "\n";
+        std::ofstream(cpu_dir / "topology" / "physical_package_id") << id % 4 / 2 << "\n";
+    }
+
+    auto all = Topology::detectTopology(root, {0, 1, 2, 3, 4, 5, 6, 7});
+    assert(Topology::physicalCores(all) == std::vector<int64_t>({0, 1, 2, 3}));
+    assert(Topology::allCpus(all) == std::vector<int64_t>({0, 1, 2, 3, 4, 5, 6, 7}));
+    assert(all[1].id == 4 && all[1].sibling == 1 && all[2].node == 0 && all[4].node == 1);
+    // with cpu 0 masked off its sibling 4 is the only thread left on that core
+    auto masked = Topology::detectTopology(root, {1, 2, 3, 4, 5, 6, 7});
+    assert(Topology::physicalCores(masked) == std::vector<int64_t>({4, 1, 2, 3}));
+    assert(Topology::allCpus(masked) == std::vector<int64_t>({4, 1, 2, 3, 5, 6, 7}));
+    assert(Topology::physicalCores(Topology::detectTopology(root, {5, 7})) == std::vector<int64_t>({5, 7}));
+    std::filesystem::remove_all(root);
+}
+
+// submit hands values and exceptions back through the future, wait() rethrows what an addJob job threw
+void test_code() {
+    test_topology();
+
+    ThreadPool::ThreadPool pool(2);
+    pool.setScratchSize(64);
+    pool.start();
+    pool.parallel_for(0, 100, 1, [&pool](int64_t i, int64_t threadId) {
+        std::span<std::byte> scratch = pool.getScratch(threadId);
+        assert(scratch.size() == 64);
+        scratch[i % 64] = std::byte{1};
+    });
+    auto boxed = pool.submit([](std::unique_ptr<int64_t> value) { return value; }, std::make_unique<int64_t>(42));
+    std::unique_ptr<int64_t> value = boxed.get();
+    assert(value && *value == 42);
+
+    auto failed = pool.submit([]() -> int64_t { throw std::runtime_error("submit"); });
+    std::string message;
+    try {
+        failed.get();
+    } catch (const std::runtime_error &error) {
+        message = error.what();
+    }
+    assert(message == "submit");
+
+    pool.addJob([](int64_t threadId) {
+        (void)threadId;
+        throw std::runtime_error("addJob");
+    });
+    message.clear();
+    try {
+        pool.wait();
+    } catch (const std::runtime_error &error) {
+        message = error.what();
+    }
+    assert(message == "addJob");
+    // it only gets rethrown once
+    pool.wait();
+    pool.stop();
+}
+
+int main(int argc, char const *argv[]) {
+    (void)argc;
+    (void)argv;
+
+    test_code();
+
+    ThreadPool::ThreadPool pool;
+    short_jobs(pool, 1000000);
+    tiny_jobs(pool, 100000, 20);
+    batch_jobs(pool, 1000000);
+    idle_latency(pool, "Park", {0, 0, false}, 2000);
+    idle_latency(pool, "Spin", {1 << 20, 0, false}, 2000);
+    idle_latency(pool, "Default", {}, 2000);
+    idle_latency(pool, "Hot", {1024, 0, true}, 2000);
+    pool.stop();
+    pool.setIdlePolicy({});
+    wordle_jobs(pool, 500);
+#ifdef THREAD_POOL_PROFILE
+    // a fresh window that fits in the record buffers
+    pool.resetProfile();
+    short_jobs(pool, 50000);
+    auto profile = pool.getProfile();
+    Profile::printSummary(std::cout, profile);
+    std::ofstream trace("pool_trace.json");
+    Profile::writeChromeTrace(trace, profile);
+#endif
+    pool.stop();
+
+    return 0;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Per job timestamps for ThreadPool, only compiled in with -DTHREAD_POOL_PROFILE (make profile)
+namespace Profile {
+// nanoseconds on the steady clock
+struct JobRecord {
+    int64_t enqueued;
+    int64_t started;
+    int64_t finished;
+};
+
+inline int64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// Only its own worker writes to it so there's no lock, once it's full the oldest records get overwritten
+class alignas(64) RecordBuffer {
+   private:
+    std::vector<JobRecord> records;
+    uint64_t next;
+
+   public:
+    RecordBuffer(size_t capacity = 1 << 16) : records(std::bit_ceil(capacity)), next(0) {}
+    void push(const JobRecord& record) { this->records[this->next++ & (this->records.size() - 1)] = record; }
+    // Oldest first, only safe to call while the worker isn't running jobs
+    std::vector<JobRecord> snapshot() const {
+        uint64_t first = this->next > this->records.size() ? this->next - this->records.size() : 0;
+        std::vector<JobRecord> result;
+        result.reserve(this->next - first);
+        for (uint64_t i = first; i < this->next; i++) result.push_back(this->records[i & (this->records.size() - 1)]);
+        return result;
+    }
+    uint64_t dropped() const { return this->next > this->records.size() ? this->next - this->records.size() : 0; }
+    void clear() { this->next = 0; }
+};
+
+struct WorkerProfile {
+    std::vector<JobRecord> records;
+    uint64_t dropped;
+    // times another thread already held this worker's queue lock
+    int64_t contended;
+};
+
+// Chrome's trace event format, load it in chrome://tracing or ui.perfetto.dev. Every job is a complete
+// event on its worker's track with the time it spent queued as an argument
+void writeChromeTrace(std::ostream& stream, const std::vector<WorkerProfile>& workers) {
+    int64_t origin = INT64_MAX;
+    for (const WorkerProfile& worker : workers)
+        for (const JobRecord& record : worker.records) origin = std::min(origin, record.enqueued);
+    stream << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    std::streamsize precision = stream.precision();
+    stream << std::fixed << std::setprecision(3);
+    for (size_t tid = 0; tid < workers.size(); tid++) {
+        stream << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << tid
+               << ",\"args\":{\"name\":\"worker " << tid << "\"}}";
+        first = false;
+        for (const JobRecord& record : workers[tid].records) {
+            stream << ",\n{\"name\":\"job\",\"ph\":\"X\",\"pid\":0,\"tid\":" << tid
+                   << ",\"ts\":" << (record.started - origin) / 1000.0
+                   << ",\"dur\":" << (record.finished - record.started) / 1000.0
+                   << ",\"args\":{\"queued_us\":" << (record.started - record.enqueued) / 1000.0 << "}}";
+        }
+    }
+    stream << "\n]}\n";
+    stream << std::defaultfloat << std::setprecision(precision);
+}
+
+// Utilization is busy time over the span from the first job starting to the last one finishing
+void printSummary(std::ostream& stream, const std::vector<WorkerProfile>& workers) {
+    int64_t first_start = INT64_MAX, last_finish = INT64_MIN;
+    std::vector<int64_t> durations, waits;
+    for (const WorkerProfile& worker : workers) {
+        for (const JobRecord& record : worker.records) {
+            first_start = std::min(first_start, record.started);
+            last_finish = std::max(last_finish, record.finished);
+            durations.push_back(record.finished - record.started);
+            waits.push_back(record.started - record.enqueued);
+        }
+    }
+    if (durations.empty()) {
+        stream << "No jobs profiled\n";
+        return;
+    }
+    int64_t span = std::max((int64_t)1, last_finish - first_start);
+    std::streamsize precision = stream.precision();
+    stream << std::fixed << std::setprecision(1);
+    stream << durations.size() << " jobs over " << span / 1e6 << " ms\n";
+    for (size_t tid = 0; tid < workers.size(); tid++) {
+        int64_t busy = 0;
+        for (const JobRecord& record : workers[tid].records) busy += record.finished - record.started;
+        stream << "Worker " << tid << ": " << workers[tid].records.size() << " jobs, " << 100.0 * busy / span
+               << "% busy, " << workers[tid].contended << " contended locks";
+        if (workers[tid].dropped) stream << ", " << workers[tid].dropped << " records dropped";
+        stream << "\n";
+    }
+
+    auto percentile = [](std::vector<int64_t>& values, int64_t percent) {
+        size_t index = std::min(values.size() - 1, values.size() * percent / 100);
+        std::nth_element(values.begin(), values.begin() + index, values.end());
+        return values[index];
+    };
+    stream << "Job duration: p50 " << percentile(durations, 50) << " ns, p99 " << percentile(durations, 99)
+           << " ns\n";
+    stream << "Queue wait: p50 " << percentile(waits, 50) << " ns, p99 " << percentile(waits, 99) << " ns\n";
+
+    // power of two buckets, bucket k holds waits in [2^(k-1), 2^k) ns
+    std::vector<int64_t> buckets(65, 0);
+    for (int64_t wait : waits) buckets[std::bit_width((uint64_t)std::max((int64_t)0, wait))]++;
+    int64_t largest = *std::max_element(buckets.begin(), buckets.end());
+    for (size_t k = 0; k < buckets.size(); k++) {
+        if (buckets[k] == 0) continue;
+        stream << "  < " << std::setw(12) << ((uint64_t)1 << k) << " ns " << std::setw(9) << buckets[k] << " "
+               << std::string(std::max((int64_t)1, 40 * buckets[k] / largest), '#') << "\n";
+    }
+    stream << std::defaultfloat << std::setprecision(precision);
+}
+}  // namespace Profile
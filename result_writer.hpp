@@ -0,0 +1,213 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <charconv>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "matrix_file.hpp"
+
+// Output for results too big for operator<<, numbers go through std::to_chars into large buffers and a
+// background thread does the actual writes so the next buffer gets filled while the last one goes out
+namespace ResultWriter {
+class BufferedFile {
+   private:
+    std::ofstream file;
+    size_t buffer_size;
+    // at most buffer_count buffers exist, the one being filled plus the ones queued or spare
+    int64_t buffer_count;
+    int64_t allocated;
+    std::vector<char> buffer;
+    size_t used;
+    std::deque<std::vector<char>> full;
+    std::vector<std::vector<char>> spare;
+    std::mutex lock;
+    std::condition_variable changed;
+    bool closing;
+    std::thread writer;
+
+    void writerLoop() {
+        std::unique_lock guard(this->lock);
+        while (true) {
+            this->changed.wait(guard, [this]() { return !this->full.empty() || this->closing; });
+            if (this->full.empty()) return;
+            std::vector<char> next = std::move(this->full.front());
+            this->full.pop_front();
+            guard.unlock();
+            this->file.write(next.data(), next.size());
+            guard.lock();
+            this->spare.push_back(std::move(next));
+            this->changed.notify_all();
+        }
+    }
+    // hands the filled part to the writer and carries on in a spare, only blocks when every buffer is queued
+    void flushBuffer() {
+        if (this->used == 0) return;
+        this->buffer.resize(this->used);
+        std::unique_lock guard(this->lock);
+        this->full.push_back(std::move(this->buffer));
+        this->changed.notify_all();
+        if (this->allocated < this->buffer_count) {
+            this->allocated++;
+            this->buffer = std::vector<char>();
+        } else {
+            this->changed.wait(guard, [this]() { return !this->spare.empty(); });
+            this->buffer = std::move(this->spare.back());
+            this->spare.pop_back();
+        }
+        guard.unlock();
+        this->buffer.resize(this->buffer_size);
+        this->used = 0;
+    }
+    char* reserve(size_t size) {
+        if (this->used + size > this->buffer_size) this->flushBuffer();
+        return this->buffer.data() + this->used;
+    }
+
+   public:
+    BufferedFile(const std::string& filename, size_t buffer_size = 1 << 20, int64_t buffer_count = 4)
+        : file(filename, std::ios::binary | std::ios::trunc),
+          buffer_size(std::max(buffer_size, (size_t)512)),
+          buffer_count(std::max(buffer_count, (int64_t)2)),
+          allocated(1),
+          buffer(this->buffer_size),
+          used(0),
+          closing(false),
+          writer(&BufferedFile::writerLoop, this) {}
+    BufferedFile(const BufferedFile&) = delete;
+    BufferedFile& operator=(const BufferedFile&) = delete;
+    ~BufferedFile() { this->close(); }
+
+    void write(std::string_view text) {
+        while (!text.empty()) {
+            size_t size = std::min(text.size(), this->buffer_size);
+            std::memcpy(this->reserve(size), text.data(), size);
+            this->used += size;
+            text.remove_prefix(size);
+        }
+    }
+    void write(int64_t value) {
+        char* out = this->reserve(20);
+        this->used = std::to_chars(out, out + 20, value).ptr - this->buffer.data();
+    }
+    // fixed with precision digits after the point, the same digits as std::fixed << std::setprecision
+    void write(double value, int precision) {
+        // the longest fixed double is 309 digits before the point
+        char* out = this->reserve(320 + precision);
+        this->used = std::to_chars(out, out + 320 + precision, value, std::chars_format::fixed, precision).ptr -
+                     this->buffer.data();
+    }
+    void put(char c) {
+        *this->reserve(1) = c;
+        this->used++;
+    }
+    void writeBytes(const void* data, size_t size) { this->write(std::string_view((const char*)data, size)); }
+    // waits for everything to reach the file, nothing can be written after
+    void close() {
+        if (!this->writer.joinable()) return;
+        this->flushBuffer();
+        {
+            std::lock_guard guard(this->lock);
+            this->closing = true;
+        }
+        this->changed.notify_all();
+        this->writer.join();
+        this->file.close();
+    }
+    bool good() const { return this->file.good(); }
+};
+
+enum FORMAT { TEXT_FORMAT, BINARY_FORMAT };
+
+struct Record {
+    int64_t key;
+    int64_t value;
+};
+
+// "key value" lines, or a MatrixFile INT64 matrix with one (key, value) row per record. The binary header
+// holds the row count so it has to be known up front either way
+class RecordWriter {
+   private:
+    BufferedFile file;
+    FORMAT format;
+    uint64_t rows;
+    uint64_t rows_written;
+
+   public:
+    RecordWriter(const std::string& filename, FORMAT format, uint64_t rows, size_t buffer_size = 1 << 20)
+        : file(filename, buffer_size), format(format), rows(rows), rows_written(0) {
+        if (format == BINARY_FORMAT) {
+            MatrixFile::Header header = MatrixFile::makeHeader<int64_t>(rows, 2, 0);
+            this->file.writeBytes(&header, sizeof(header));
+        }
+    }
+    ~RecordWriter() { assert(this->rows_written == this->rows); }
+    void write(int64_t key, int64_t value) {
+        assert(this->rows_written < this->rows);
+        this->rows_written++;
+        if (this->format == BINARY_FORMAT) {
+            Record record{key, value};
+            this->file.writeBytes(&record, sizeof(record));
+            return;
+        }
+        this->file.write(key);
+        this->file.put(' ');
+        this->file.write(value);
+        this->file.put('\n');
+    }
+    void write(const Record& record) { this->write(record.key, record.value); }
+    void close() { this->file.close(); }
+};
+
+// The k best items seen so far, kept in a heap with the worst of them on top so an item that doesn't make it
+// costs one comparison and nothing ever gets fully sorted. better(a, b) is true when a goes before b
+template <typename T, typename Better>
+class TopK {
+   private:
+    size_t k;
+    Better better;
+    std::vector<T> heap;
+
+   public:
+    TopK(size_t k, Better better = Better()) : k(k), better(better) { this->heap.reserve(k); }
+    void push(const T& item) {
+        if (this->heap.size() < this->k) {
+            this->heap.push_back(item);
+            std::push_heap(this->heap.begin(), this->heap.end(), this->better);
+        } else if (this->k > 0 && this->better(item, this->heap.front())) {
+            std::pop_heap(this->heap.begin(), this->heap.end(), this->better);
+            this->heap.back() = item;
+            std::push_heap(this->heap.begin(), this->heap.end(), this->better);
+        }
+    }
+    // best first
+    std::vector<T> sorted() const {
+        std::vector<T> result = this->heap;
+        std::sort_heap(result.begin(), result.end(), this->better);
+        return result;
+    }
+};
+
+// Indices of values with the biggest value first and ties in index order. A counting sort, the values are
+// counts so they're small and never negative, and it only needs the indices instead of (index, value) pairs
+std::vector<int64_t> orderByValue(const std::vector<int64_t>& values) {
+    int64_t largest = 0;
+    for (int64_t value : values) largest = std::max(largest, value);
+    // starts[v] ends up as the first slot for value v, bigger values go first
+    std::vector<int64_t> starts(largest + 2, 0);
+    for (int64_t value : values) starts[largest - value + 1]++;
+    for (int64_t v = 1; v < largest + 2; v++) starts[v] += starts[v - 1];
+    std::vector<int64_t> order(values.size());
+    for (size_t i = 0; i < values.size(); i++) order[starts[largest - values[i]]++] = i;
+    return order;
+}
+}  // namespace ResultWriter
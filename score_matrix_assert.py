@@ -1,8 +1,45 @@
-score_data = open("wordle_scores.txt", "r").read().strip().split("\n")
-matrix_data = open("wordle_matrix.txt", "r").read().strip().split("\n")
+import mmap
+import os
+import struct
 
-assert len(score_data) == len(matrix_data)
+HEADER = struct.Struct("<8sIIQQQ24x")
+DTYPES = {1: "B", 2: "H", 3: "I", 4: "q"}
 
-for score, matrix in zip(score_data, matrix_data):
-    m_sum = sum([int(y) for y in matrix.strip().split(" ")])
-    assert int(score) == m_sum
+
+def words_checksum(words):
+    # FNV-1a like wordsChecksum in matrix_file.hpp, every word followed by a newline
+    value = 14695981039346656037
+    for byte in "".join(word + "\n" for word in words).encode():
+        value = ((value ^ byte) * 1099511628211) & 0xFFFFFFFFFFFFFFFF
+    return value
+
+
+def read_matrix(filename, words):
+    # see matrix_file.hpp, returns the rows as memoryviews into the mapped file
+    with open(filename, "rb") as f:
+        data = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+    magic, version, dtype, rows, cols, checksum = HEADER.unpack_from(data)
+    assert magic == b"TPMATRIX" and version == 1
+    assert checksum == words_checksum(words), filename + " was written for a different word list"
+    values = memoryview(data)[HEADER.size:].cast(DTYPES[dtype])
+    assert len(values) == rows * cols
+    return [values[i * cols:(i + 1) * cols] for i in range(rows)]
+
+
+words = open("wordle-nyt-words-14855.txt", "r").read().split()
+
+if os.path.exists("wordle_scores.bin"):
+    score_data = [row[0] for row in read_matrix("wordle_scores.bin", words)]
+else:
+    score_data = [int(x) for x in open("wordle_scores.txt", "r").read().strip().split("\n")]
+
+if os.path.exists("wordle_matrix.bin"):
+    matrix_sums = [sum(row) for row in read_matrix("wordle_matrix.bin", words)]
+else:
+    matrix_data = open("wordle_matrix.txt", "r").read().strip().split("\n")
+    matrix_sums = [sum([int(y) for y in matrix.strip().split(" ")]) for matrix in matrix_data]
+
+assert len(score_data) == len(matrix_sums)
+
+for score, m_sum in zip(score_data, matrix_sums):
+    assert score == m_sum
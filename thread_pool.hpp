@@ -2,18 +2,41 @@
 // https://stackoverflow.com/questions/15752659/thread-pooling-in-c11
 #pragma once
 
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
 #include <chrono>
 #include <cmath>
 #include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstring>
+#include <exception>
 #include <functional>
+#include <future>
 #include <iomanip>
 #include <iostream>
+#include <latch>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <new>
+#include <optional>
+#include <ranges>
+#include <span>
 #include <stdfloat>
+#include <stop_token>
 #include <thread>
+#include <type_traits>
 #include <vector>
 
+#include "cpu_topology.hpp"
+#ifdef THREAD_POOL_PROFILE
+#include "pool_profile.hpp"
+#endif
+
 namespace Timer {
 void printTime(std::ostream& stream, const std::chrono::steady_clock::time_point& startTime,
                const std::chrono::steady_clock::time_point& stopTime) {
@@ -72,32 +95,455 @@ void printTime(std::ostream& stream, const std::chrono::steady_clock::time_point
 }  // namespace Timer
 
 namespace ThreadPool {
+enum PARTITION { STATIC_PARTITION, GUIDED_PARTITION };
+
+// Which cpus workers get pinned to, see cpu_topology.hpp for the ordering
+enum PLACEMENT { NO_PLACEMENT, PHYSICAL_CORES, ALL_CPUS };
+
+// What a worker does once it runs out of jobs: spin on pause, then yield, then park on threadWait.
+// keepHot never parks so workers stay awake between wait() calls until stop()
+struct IdlePolicy {
+    int64_t spinCount = 1024;
+    int64_t yieldCount = 16;
+    bool keepHot = false;
+};
+
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// Move-only void(int64_t) job, anything that fits in inlineSize is stored in place so queueing it doesn't allocate
+class Task {
+   public:
+    static constexpr size_t inlineSize = 112;
+
+   private:
+    alignas(std::max_align_t) unsigned char storage[inlineSize];
+    void (*invokeFn)(void*, int64_t);
+    // moves the callable from src into dst and destroys src, a null dst only destroys
+    void (*manageFn)(void* dst, void* src);
+
+    template <typename F>
+    static constexpr bool fitsInline =
+        sizeof(F) <= inlineSize && alignof(F) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<F>;
+
+   public:
+    Task() noexcept : invokeFn(nullptr), manageFn(nullptr) {}
+    template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Task>>>
+    Task(F&& func) {
+        using Func = std::decay_t<F>;
+        if constexpr (fitsInline<Func>) {
+            new (this->storage) Func(std::forward<F>(func));
+            this->invokeFn = [](void* data, int64_t threadId) { (*(Func*)data)(threadId); };
+            this->manageFn = [](void* dst, void* src) {
+                if (dst) new (dst) Func(std::move(*(Func*)src));
+                ((Func*)src)->~Func();
+            };
+        } else {
+            new (this->storage) Func*(new Func(std::forward<F>(func)));
+            this->invokeFn = [](void* data, int64_t threadId) { (**(Func**)data)(threadId); };
+            this->manageFn = [](void* dst, void* src) {
+                if (dst)
+                    new (dst) Func*(*(Func**)src);
+                else
+                    delete *(Func**)src;
+            };
+        }
+    }
+    Task(Task&& other) noexcept : invokeFn(other.invokeFn), manageFn(other.manageFn) {
+        if (this->manageFn) other.manageFn(this->storage, other.storage);
+        other.invokeFn = nullptr;
+        other.manageFn = nullptr;
+    }
+    Task& operator=(Task&& other) noexcept {
+        if (this == &other) return *this;
+        this->reset();
+        this->invokeFn = other.invokeFn;
+        this->manageFn = other.manageFn;
+        if (this->manageFn) other.manageFn(this->storage, other.storage);
+        other.invokeFn = nullptr;
+        other.manageFn = nullptr;
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() { this->reset(); }
+    void reset() {
+        if (this->manageFn) this->manageFn(nullptr, this->storage);
+        this->invokeFn = nullptr;
+        this->manageFn = nullptr;
+    }
+    void operator()(int64_t threadId) { this->invokeFn(this->storage, threadId); }
+    explicit operator bool() const { return this->invokeFn != nullptr; }
+};
+
+// HIGH_PRIORITY jobs get popped and stolen before any NORMAL_PRIORITY job is looked at
+enum PRIORITY { HIGH_PRIORITY, NORMAL_PRIORITY };
+constexpr int64_t priorityCount = 2;
+
+// Jobs added with a group can be waited on or cancelled without touching the rest of the pool.
+// Cancelling is cooperative, queued jobs of a cancelled group get dropped and running ones can poll
+// isCancelled() or a stop_token from getToken(). The group has to outlive its jobs
+class JobGroup {
+   private:
+    alignas(64) std::atomic<int64_t> unfinishedJobs;
+    std::stop_source source;
+    std::mutex groupLock;
+    std::condition_variable groupWait;
+    std::exception_ptr firstException;
+
+    friend class ThreadPool;
+
+    // Only the last job takes groupLock, and it notifies while holding it so a waiter can't see zero
+    // and destroy the group underneath it
+    void finishJob() {
+        int64_t remaining = this->unfinishedJobs;
+        while (remaining > 1)
+            if (this->unfinishedJobs.compare_exchange_weak(remaining, remaining - 1)) return;
+        std::unique_lock<std::mutex> lock(this->groupLock);
+        if (--this->unfinishedJobs == 0) this->groupWait.notify_all();
+    }
+    void storeException(std::exception_ptr exception) {
+        std::unique_lock<std::mutex> lock(this->groupLock);
+        if (!this->firstException) this->firstException = exception;
+    }
+
+   public:
+    JobGroup() : unfinishedJobs{0} {}
+    JobGroup(const JobGroup&) = delete;
+    JobGroup& operator=(const JobGroup&) = delete;
+    void cancel() { this->source.request_stop(); }
+    bool isCancelled() const { return this->source.stop_requested(); }
+    std::stop_token getToken() const { return this->source.get_token(); }
+    int64_t pending() const { return this->unfinishedJobs; }
+    // Clears the cancellation and any stored exception so the group can be used for another round
+    void reset() {
+        assert(this->unfinishedJobs == 0);
+        std::unique_lock<std::mutex> lock(this->groupLock);
+        this->source = std::stop_source();
+        this->firstException = nullptr;
+    }
+};
+
+// What actually sits in the queues, group is null for jobs that don't belong to one
+struct QueuedJob {
+    Task task;
+    JobGroup* group = nullptr;
+#ifdef THREAD_POOL_PROFILE
+    int64_t enqueued = 0;
+#endif
+};
+
+// One of these per worker, the owner pops from the back and everyone else steals from the front.
+// Every priority gets a ring buffer that only ever grows, so once they're big enough pushing doesn't allocate
+class alignas(64) WorkerQueue {
+   private:
+    struct Lane {
+        std::vector<QueuedJob> jobs = std::vector<QueuedJob>(256);
+        uint64_t head = 0;
+        uint64_t tail = 0;
+
+        QueuedJob& at(uint64_t i) { return this->jobs[i & (this->jobs.size() - 1)]; }
+        void grow() {
+            std::vector<QueuedJob> bigger(this->jobs.size() * 2);
+            for (uint64_t i = this->head; i < this->tail; i++)
+                bigger[i & (bigger.size() - 1)] = std::move(this->at(i));
+            this->jobs.swap(bigger);
+        }
+    };
+    std::mutex queueLock;
+    Lane lanes[priorityCount];
+#ifdef THREAD_POOL_PROFILE
+    int64_t contended = 0;
+#endif
+
+    std::unique_lock<std::mutex> lockQueue() {
+#ifdef THREAD_POOL_PROFILE
+        std::unique_lock<std::mutex> lock(this->queueLock, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            lock.lock();
+            this->contended++;
+        }
+        return lock;
+#else
+        return std::unique_lock<std::mutex>(this->queueLock);
+#endif
+    }
+
+   public:
+    void push(QueuedJob&& job, PRIORITY priority) {
+        std::unique_lock<std::mutex> lock = this->lockQueue();
+        Lane& lane = this->lanes[priority];
+        if (lane.tail - lane.head == lane.jobs.size()) lane.grow();
+        lane.at(lane.tail++) = std::move(job);
+    }
+    bool pop(QueuedJob& job, PRIORITY priority) {
+        std::unique_lock<std::mutex> lock = this->lockQueue();
+        Lane& lane = this->lanes[priority];
+        if (lane.head == lane.tail) return false;
+        job = std::move(lane.at(--lane.tail));
+        return true;
+    }
+    // Moves count jobs in under one lock, it is left pointing past the last one taken
+    template <typename Iter, bool moveJobs>
+    void pushBatch(Iter& it, int64_t count, JobGroup* group, PRIORITY priority) {
+        std::unique_lock<std::mutex> lock = this->lockQueue();
+        Lane& lane = this->lanes[priority];
+        while (lane.tail - lane.head + count > lane.jobs.size()) lane.grow();
+#ifdef THREAD_POOL_PROFILE
+        int64_t enqueued = Profile::now();
+#endif
+        for (int64_t i = 0; i < count; i++, ++it) {
+            QueuedJob& job = lane.at(lane.tail++);
+            if constexpr (moveJobs)
+                job = QueuedJob{Task(std::move(*it)), group};
+            else
+                job = QueuedJob{Task(*it), group};
+#ifdef THREAD_POOL_PROFILE
+            job.enqueued = enqueued;
+#endif
+        }
+    }
+    bool steal(QueuedJob& job, PRIORITY priority) {
+        std::unique_lock<std::mutex> lock = this->lockQueue();
+        Lane& lane = this->lanes[priority];
+        if (lane.head == lane.tail) return false;
+        job = std::move(lane.at(lane.head++));
+        return true;
+    }
+#ifdef THREAD_POOL_PROFILE
+    int64_t getContended() { return this->contended; }
+    void resetContended() { this->contended = 0; }
+#endif
+    // Every job still queued goes through discard on its way out
+    template <typename Discard>
+    void clear(Discard&& discard) {
+        std::unique_lock<std::mutex> lock = this->lockQueue();
+        for (Lane& lane : this->lanes) {
+            while (lane.head != lane.tail) {
+                QueuedJob job = std::move(lane.at(lane.head++));
+                discard(job);
+            }
+        }
+    }
+};
+
+template <typename T>
+class ThreadLocal;
+
 // I hope there's no race conditions or unexpected behavior
 class ThreadPool {
    private:
-    bool stopThreads;
+    std::atomic<bool> stopThreads;
     bool isActive;
     int64_t threadCount;
-    int64_t jobCount;
-    int64_t activeThreads;
-    std::condition_variable mainWait;
+    // Hot counters get their own cache lines, completed = jobCount - unfinishedJobs and
+    // running = unfinishedJobs - queuedJobs so the progress reporter never needs a lock
+    alignas(64) std::atomic<int64_t> jobCount;
+    alignas(64) std::atomic<int64_t> queuedJobs;
+    alignas(64) std::atomic<int64_t> queuedHighJobs;
+    alignas(64) std::atomic<int64_t> unfinishedJobs;
+    alignas(64) std::atomic<int64_t> idleThreads;
+    alignas(64) std::atomic<uint64_t> nextQueue;
     std::mutex threadLock;
     std::condition_variable threadWait;
     std::vector<std::thread> threads;
-    std::queue<std::function<void(int64_t)>> jobs;
+    std::vector<WorkerQueue> queues;
+    std::mutex exceptionLock;
+    std::exception_ptr firstException;
+    IdlePolicy idlePolicy;
+    std::vector<int64_t> workerCpus;
+    size_t scratchSize;
+    std::vector<std::unique_ptr<std::byte[]>> scratch;
+#ifdef THREAD_POOL_PROFILE
+    std::vector<Profile::RecordBuffer> profiles;
+#endif
+
+    void waitQuiet() {
+        int64_t remaining = this->unfinishedJobs;
+        while (remaining != 0) {
+            this->unfinishedJobs.wait(remaining);
+            remaining = this->unfinishedJobs;
+        }
+    }
+
+    static inline thread_local ThreadPool* currentPool = nullptr;
+    static inline thread_local int64_t currentThreadId = -1;
+
+    bool popJob(int64_t threadId, QueuedJob& job) {
+        if (this->queuedJobs <= 0) return false;
+        for (int64_t lane = 0; lane < priorityCount; lane++) {
+            PRIORITY priority = (PRIORITY)lane;
+            if (priority == HIGH_PRIORITY && this->queuedHighJobs <= 0) continue;
+            bool found = this->queues[threadId].pop(job, priority);
+            for (int64_t i = 1; !found && i < this->threadCount; i++)
+                found = this->queues[(threadId + i) % this->threadCount].steal(job, priority);
+            if (!found) continue;
+            this->queuedJobs--;
+            if (priority == HIGH_PRIORITY) this->queuedHighJobs--;
+            return true;
+        }
+        return false;
+    }
+
+    void storeException(std::exception_ptr exception) {
+        std::unique_lock<std::mutex> lock(this->exceptionLock);
+        if (!this->firstException) this->firstException = exception;
+    }
+
+    void rethrowException() {
+        std::unique_lock<std::mutex> lock(this->exceptionLock);
+        if (!this->firstException) return;
+        std::exception_ptr exception = this->firstException;
+        this->firstException = nullptr;
+        lock.unlock();
+        std::rethrow_exception(exception);
+    }
+
+    void wakeWorkers(int64_t count) {
+        if (this->idleThreads <= 0) return;
+        std::unique_lock<std::mutex> lock(this->threadLock);
+        int64_t idle = this->idleThreads;
+        if (count >= idle) {
+            this->threadWait.notify_all();
+            return;
+        }
+        for (int64_t i = 0; i < count; i++) this->threadWait.notify_one();
+    }
+
+    // unfinishedJobs doubles as the completion latch, waiters only need waking when it hits zero
+    void finishJob() {
+        if (--this->unfinishedJobs == 0) this->unfinishedJobs.notify_all();
+    }
+
+    // Jobs of a cancelled group get dropped without running but still count as finished
+    void runJob(QueuedJob& job, int64_t threadId) {
+        JobGroup* group = job.group;
+#ifdef THREAD_POOL_PROFILE
+        int64_t started = Profile::now();
+#endif
+        if (!group || !group->isCancelled()) {
+            try {
+                job.task(threadId);
+            } catch (...) {
+                if (group)
+                    group->storeException(std::current_exception());
+                else
+                    this->storeException(std::current_exception());
+            }
+        }
+#ifdef THREAD_POOL_PROFILE
+        this->profiles[threadId].push({job.enqueued, started, Profile::now()});
+#endif
+        job.task.reset();
+        job.group = nullptr;
+        if (group) group->finishJob();
+        this->finishJob();
+    }
+
+    void pushJob(QueuedJob&& job, PRIORITY priority) {
+        this->jobCount++;
+        this->unfinishedJobs++;
+        this->queuedJobs++;
+        if (priority == HIGH_PRIORITY) this->queuedHighJobs++;
+#ifdef THREAD_POOL_PROFILE
+        job.enqueued = Profile::now();
+#endif
+        int64_t queueId = currentPool == this ? currentThreadId : this->nextQueue++ % this->threadCount;
+        this->queues[queueId].push(std::move(job), priority);
+        this->wakeWorkers(1);
+    }
+
+    template <typename Range>
+    void pushJobs(Range&& jobs, JobGroup* group, PRIORITY priority) {
+        int64_t count = std::ranges::size(jobs);
+        if (count == 0) return;
+        if (group) group->unfinishedJobs += count;
+        this->jobCount += count;
+        this->unfinishedJobs += count;
+        this->queuedJobs += count;
+        if (priority == HIGH_PRIORITY) this->queuedHighJobs += count;
+        int64_t sliceCount = std::min(count, this->threadCount);
+        uint64_t firstQueue = this->nextQueue.fetch_add(sliceCount);
+        auto it = std::ranges::begin(jobs);
+        for (int64_t slice = 0; slice < sliceCount; slice++) {
+            int64_t sliceSize = count / sliceCount + (slice < count % sliceCount);
+            WorkerQueue& queue = this->queues[(firstQueue + slice) % this->threadCount];
+            queue.template pushBatch<decltype(it), !std::is_lvalue_reference_v<Range>>(it, sliceSize, group,
+                                                                                        priority);
+        }
+        this->wakeWorkers(count);
+    }
+
+    void printProgress(std::ostream& stream, const std::chrono::steady_clock::time_point& start) {
+        using std::float64_t;
+        auto stop = std::chrono::steady_clock::now();
+        int64_t jobCount = this->jobCount;
+        int64_t remainingJobs = std::min(jobCount, (int64_t)this->unfinishedJobs);
+        int64_t completedJobs = std::max((int64_t)0, jobCount - remainingJobs);
+        stream << "\33[2K\r";
+        stream << completedJobs << " / " << jobCount << " - ";
+        Timer::printTime(stream, start, stop);
+        stream << " < ";
+        if (completedJobs != 0) {
+            auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start);
+            float64_t timePerJob = duration.count() / (float64_t)(completedJobs);
+            auto nanoTime = remainingJobs * timePerJob;
+            Timer::printTime(stream, stop, stop + std::chrono::nanoseconds((int64_t)nanoTime));
+        } else {
+            stream << "unknown";
+        }
+        stream << std::flush;
+    }
+
+    // True as soon as there's something to do, false when it's time to park
+    bool spinForJob() {
+        auto hasWork = [this]() { return this->queuedJobs > 0 || this->stopThreads; };
+        for (int64_t i = 0; i < this->idlePolicy.spinCount; i++) {
+            if (hasWork()) return true;
+            cpuRelax();
+        }
+        for (int64_t i = 0; i < this->idlePolicy.yieldCount || this->idlePolicy.keepHot; i++) {
+            if (hasWork()) return true;
+            std::this_thread::yield();
+        }
+        return hasWork();
+    }
+
+    // Runs on the new worker so the scratch pages get first touched from the cpu it's pinned to,
+    // which is what puts them on that cpu's NUMA node
+    void initWorker(int64_t threadId) {
+        if (!this->workerCpus.empty()) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(this->workerCpus[threadId % this->workerCpus.size()], &cpus);
+            // not being allowed on that cpu isn't fatal, the worker just stays unpinned
+            pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        }
+        if (this->scratchSize > 0) {
+            this->scratch[threadId] = std::make_unique_for_overwrite<std::byte[]>(this->scratchSize);
+            std::memset(this->scratch[threadId].get(), 0, this->scratchSize);
+        }
+    }
 
     void threadLoop(int64_t threadId) {
-        while (true) {
+        currentPool = this;
+        currentThreadId = threadId;
+        QueuedJob job;
+        while (!this->stopThreads) {
+            if (this->popJob(threadId, job)) {
+                this->runJob(job, threadId);
+                continue;
+            }
+            if (this->spinForJob()) continue;
             std::unique_lock<std::mutex> lock(this->threadLock);
-            this->activeThreads--;
-            this->mainWait.notify_all();
-            this->threadWait.wait(lock, [this]() { return !this->jobs.empty() || this->stopThreads; });
-            if (this->stopThreads) return;
-            auto job = this->jobs.front();
-            this->jobs.pop();
-            this->activeThreads++;
-            lock.unlock();
-            job(threadId);
+            this->idleThreads++;
+            this->threadWait.wait(lock, [this]() { return this->queuedJobs > 0 || this->stopThreads; });
+            this->idleThreads--;
         }
     }
 
@@ -107,14 +553,34 @@ class ThreadPool {
           isActive{false},
           threadCount{threadCount},
           jobCount{0},
-          activeThreads{0},
-          threads(threadCount) {}
+          queuedJobs{0},
+          queuedHighJobs{0},
+          unfinishedJobs{0},
+          idleThreads{0},
+          nextQueue{0},
+          threads(threadCount),
+          queues(threadCount),
+          scratchSize{0},
+          scratch(threadCount) {
+#ifdef THREAD_POOL_PROFILE
+        this->profiles.resize(threadCount);
+#endif
+    }
     ThreadPool() : ThreadPool((int64_t)std::thread::hardware_concurrency()) {}
     void start() {
-        if (this->isActive) return;
-        this->activeThreads = this->threadCount;
-        for (int64_t i = 0; i < this->threadCount; i++)
-            this->threads[i] = std::thread([this, i]() { this->threadLoop(i); });
+        // jobs queued before start() can already be running before isActive gets set
+        if (currentPool == this || this->isActive) return;
+        this->scratch.clear();
+        this->scratch.resize(this->threadCount);
+        std::latch ready(this->threadCount);
+        for (int64_t i = 0; i < this->threadCount; i++) {
+            this->threads[i] = std::thread([this, i, &ready]() {
+                this->initWorker(i);
+                ready.count_down();
+                this->threadLoop(i);
+            });
+        }
+        ready.wait();
         this->isActive = true;
     }
     void stop() {
@@ -127,56 +593,312 @@ class ThreadPool {
         this->stopThreads = false;
         this->threads.clear();
         this->threads.resize(this->threadCount);
-        std::queue<std::function<void(int64_t)>> emptyQueue;
-        this->jobs = emptyQueue;
+        // dropped jobs still have to be taken off their group or wait(group) would never return
+        for (WorkerQueue& queue : this->queues) {
+            queue.clear([](QueuedJob& job) {
+                job.task.reset();
+                if (job.group) job.group->finishJob();
+            });
+        }
+        this->queuedJobs = 0;
+        this->queuedHighJobs = 0;
+        this->unfinishedJobs = 0;
         this->jobCount = 0;
+        this->firstException = nullptr;
         this->isActive = false;
-        this->mainWait.notify_all();
+        this->unfinishedJobs.notify_all();
     }
+    // Progress gets printed every 100 ms from a separate thread while this one waits quietly
     void wait(std::ostream& stream) {
-        using std::float64_t;
-        std::unique_lock<std::mutex> lock(this->threadLock);
         std::cout << this->threadCount << " Threads:\n";
         auto start = std::chrono::steady_clock::now();
-        this->mainWait.wait(lock, [this, &stream, &start] {
-            auto stop = std::chrono::steady_clock::now();
-            int64_t activeThreads = this->activeThreads;
-            int64_t jobCount = this->jobCount;
-            int64_t remainingJobs = std::min(jobCount, (int64_t)this->jobs.size() + activeThreads);
-            int64_t completedJobs = std::max((int64_t)0, this->jobCount - remainingJobs - activeThreads);
-            stream << "\33[2K\r";
-            stream << completedJobs << " / " << jobCount << " - ";
-            Timer::printTime(stream, start, stop);
-            stream << " < ";
-            if (completedJobs != 0) {
-                auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start);
-                float64_t timePerJob = duration.count() / (float64_t)(completedJobs);
-                auto nanoTime = remainingJobs * timePerJob;
-                Timer::printTime(stream, stop, stop + std::chrono::nanoseconds((int64_t)nanoTime));
-            } else {
-                stream << "unknown";
+        std::mutex reporterLock;
+        std::condition_variable_any reporterWait;
+        std::jthread reporter([this, &stream, &start, &reporterLock, &reporterWait](std::stop_token stopToken) {
+            std::unique_lock<std::mutex> lock(reporterLock);
+            while (!stopToken.stop_requested()) {
+                this->printProgress(stream, start);
+                reporterWait.wait_for(lock, stopToken, std::chrono::milliseconds(100), [] { return false; });
             }
-            stream << std::flush;
-            return this->jobs.empty() && this->activeThreads == 0;
         });
+        this->waitQuiet();
+        reporter.request_stop();
+        reporter.join();
+        this->printProgress(stream, start);
         stream << std::endl;
         this->jobCount = 0;
+        this->rethrowException();
     }
     void wait() {
-        std::unique_lock<std::mutex> lock(this->threadLock);
-        this->mainWait.wait(lock, [this] { return this->jobs.empty() && this->activeThreads == 0; });
+        this->waitQuiet();
+        this->rethrowException();
     }
-    bool isBusy() {
-        std::unique_lock<std::mutex> lock(this->threadLock);
-        return this->jobs.empty();
+    // Only waits for the group's jobs, anything else in the pool can still be running afterwards.
+    // Called from one of this pool's workers it runs queued jobs instead of blocking, so a job can wait on
+    // jobs it added itself. Rethrows the first exception one of the group's jobs threw
+    void wait(JobGroup& group) {
+        if (currentPool == this) {
+            QueuedJob job;
+            for (int64_t idle = 0; group.unfinishedJobs > 0;) {
+                if (this->popJob(currentThreadId, job)) {
+                    this->runJob(job, currentThreadId);
+                    idle = 0;
+                } else if (idle++ < this->idlePolicy.spinCount) {
+                    cpuRelax();
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        }
+        std::unique_lock<std::mutex> lock(group.groupLock);
+        group.groupWait.wait(lock, [&group]() { return group.unfinishedJobs == 0; });
+        std::exception_ptr exception = group.firstException;
+        group.firstException = nullptr;
+        lock.unlock();
+        if (exception) std::rethrow_exception(exception);
     }
-    void addJob(const std::function<void(int64_t)>& job) {
-        std::unique_lock<std::mutex> lock(this->threadLock);
-        this->jobCount++;
-        this->jobs.push(job);
-        this->threadWait.notify_one();
+    bool isBusy() { return this->queuedJobs == 0; }
+    // Works the same before or after start(), once the pool is running a job only takes its queue's lock
+    // and threadLock is only touched when there's a parked worker to wake up
+    void addJob(Task job, PRIORITY priority = NORMAL_PRIORITY) { this->pushJob({std::move(job), nullptr}, priority); }
+    void addJob(Task job, JobGroup& group, PRIORITY priority = NORMAL_PRIORITY) {
+        group.unfinishedJobs++;
+        this->pushJob({std::move(job), &group}, priority);
+    }
+    // Splits a sized range of jobs into one contiguous slice per queue, every queue is locked once and
+    // only as many parked workers as there are new jobs get woken up
+    template <typename Range>
+    void addJobs(Range&& jobs, PRIORITY priority = NORMAL_PRIORITY) {
+        this->pushJobs(std::forward<Range>(jobs), nullptr, priority);
     }
+    template <typename Range>
+    void addJobs(Range&& jobs, JobGroup& group, PRIORITY priority = NORMAL_PRIORITY) {
+        this->pushJobs(std::forward<Range>(jobs), &group, priority);
+    }
+    // Exceptions thrown by the job end up in the future, addJob exceptions get rethrown by wait()
+    template <typename F, typename... Args>
+    auto submit(F&& func, Args&&... args) -> std::future<std::invoke_result_t<F, Args...>> {
+        using Result = std::invoke_result_t<F, Args...>;
+        std::packaged_task<Result()> task(
+            [func = std::forward<F>(func), ... args = std::forward<Args>(args)]() mutable -> Result {
+                return std::invoke(std::move(func), std::move(args)...);
+            });
+        std::future<Result> result = task.get_future();
+        this->addJob([task = std::move(task)](int64_t threadId) mutable {
+            (void)threadId;
+            task();
+        });
+        return result;
+    }
+    // co_await pool.schedule() suspends the coroutine and resumes it as a job on one of the workers.
+    // The job only captures the handle so it fits in Task's inline buffer, see async_task.hpp
+    auto schedule(PRIORITY priority = NORMAL_PRIORITY) {
+        struct Awaiter {
+            ThreadPool& pool;
+            PRIORITY priority;
+
+            bool await_ready() const noexcept { return false; }
+            // the awaiter lives in the coroutine frame, which can be resumed on a worker before addJob returns
+            void await_suspend(std::coroutine_handle<> handle) {
+                ThreadPool& pool = this->pool;
+                pool.start();
+                pool.addJob(
+                    [handle](int64_t threadId) {
+                        (void)threadId;
+                        handle.resume();
+                    },
+                    this->priority);
+            }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{*this, priority};
+    }
+    // Runs body(i) or body(i, threadId) for every i in [begin, end) and blocks until it's done
+    // Static hands out fixed chunks of grain, guided hands out shrinking chunks of at least grain.
+    // Safe to call from inside a job, the calling worker helps out instead of blocking
+    template <typename Body>
+    void parallel_for(int64_t begin, int64_t end, int64_t grain, Body&& body,
+                      PARTITION partition = GUIDED_PARTITION) {
+        if (begin >= end) return;
+        int64_t count = end - begin;
+        if (grain <= 0) grain = std::max((int64_t)1, count / (this->threadCount * 8));
+        int64_t chunkCount = (count + grain - 1) / grain;
+        int64_t jobTotal = partition == STATIC_PARTITION ? chunkCount : std::min(chunkCount, this->threadCount);
+
+        JobGroup group;
+        auto runRange = [&body](int64_t lo, int64_t hi, int64_t threadId) {
+            for (int64_t i = lo; i < hi; i++) {
+                if constexpr (std::is_invocable_v<Body&, int64_t, int64_t>)
+                    body(i, threadId);
+                else
+                    body(i);
+            }
+        };
+
+        std::atomic<int64_t> next{begin};
+        int64_t threadCount = this->threadCount;
+        auto jobs = std::views::iota((int64_t)0, jobTotal);
+        if (partition == STATIC_PARTITION) {
+            this->addJobs(jobs | std::views::transform([&runRange, begin, end, grain](int64_t job) {
+                              int64_t lo = begin + job * grain;
+                              int64_t hi = std::min(end, lo + grain);
+                              return [&runRange, lo, hi](int64_t threadId) { runRange(lo, hi, threadId); };
+                          }),
+                          group);
+        } else {
+            this->addJobs(jobs | std::views::transform([&runRange, &next, end, grain, threadCount](int64_t) {
+                              return [&runRange, &next, end, grain, threadCount](int64_t threadId) {
+                                  int64_t lo = next;
+                                  while (lo < end) {
+                                      int64_t size = std::max(grain, (end - lo) / (2 * threadCount));
+                                      int64_t hi = std::min(end, lo + size);
+                                      if (!next.compare_exchange_weak(lo, hi)) continue;
+                                      runRange(lo, hi, threadId);
+                                      lo = next;
+                                  }
+                              };
+                          }),
+                          group);
+        }
+        this->start();
+        this->wait(group);
+    }
+
+    // Each worker folds into its own accumulator (a copy of init) and they get combined at the end,
+    // map is either map(i) -> value or map(accumulator, i) to update in place
+    template <typename T, typename Map, typename Combine>
+    T parallel_reduce(int64_t begin, int64_t end, const T& init, Map&& map, Combine&& combine, int64_t grain = 0,
+                      PARTITION partition = GUIDED_PARTITION) {
+        ThreadLocal<std::optional<T>> accumulators(*this, std::nullopt);
+        this->parallel_for(
+            begin, end, grain,
+            [&accumulators, &init, &map, &combine](int64_t i, int64_t threadId) {
+                std::optional<T>& accumulator = accumulators[threadId];
+                if (!accumulator) accumulator.emplace(init);
+                if constexpr (std::is_invocable_v<Map&, T&, int64_t>)
+                    map(*accumulator, i);
+                else
+                    *accumulator = combine(std::move(*accumulator), map(i));
+            },
+            partition);
+
+        std::optional<T> result = accumulators.combine([&combine](std::optional<T> a, std::optional<T> b) {
+            if (!a) return b;
+            if (b) *a = combine(std::move(*a), std::move(*b));
+            return a;
+        });
+        return result ? std::move(*result) : init;
+    }
+    // Workers read it while they're idle, so only change it while the pool is stopped
+    void setIdlePolicy(const IdlePolicy& policy) {
+        assert(!this->isActive);
+        this->idlePolicy = policy;
+    }
+    IdlePolicy getIdlePolicy() { return this->idlePolicy; }
+    // Worker i goes on cpus[i % cpus.size()], an empty list leaves them to the scheduler
+    void setAffinity(const std::vector<int64_t>& cpus) {
+        assert(!this->isActive);
+        this->workerCpus = cpus;
+    }
+    void setPlacement(PLACEMENT placement) {
+        auto cpus = Topology::detectTopology();
+        if (placement == PHYSICAL_CORES)
+            this->setAffinity(Topology::physicalCores(cpus));
+        else if (placement == ALL_CPUS)
+            this->setAffinity(Topology::allCpus(cpus));
+        else
+            this->setAffinity({});
+    }
+    // Every worker allocates and touches its own block of this many bytes when it starts
+    void setScratchSize(size_t bytes) {
+        assert(!this->isActive);
+        this->scratchSize = bytes;
+    }
+    // Only from inside a job, a worker's block exists once it has started
+    std::span<std::byte> getScratch(int64_t threadId) {
+        assert(threadId >= 0 && threadId < this->threadCount);
+        assert(this->scratchSize == 0 || this->scratch[threadId]);
+        return {this->scratch[threadId].get(), this->scratchSize};
+    }
+#ifdef THREAD_POOL_PROFILE
+    // What every worker recorded since the last resetProfile(), only call it while no jobs are running
+    std::vector<Profile::WorkerProfile> getProfile() {
+        std::vector<Profile::WorkerProfile> result;
+        for (int64_t i = 0; i < this->threadCount; i++) {
+            Profile::RecordBuffer& profile = this->profiles[i];
+            result.push_back({profile.snapshot(), profile.dropped(), this->queues[i].getContended()});
+        }
+        return result;
+    }
+    void resetProfile() {
+        for (Profile::RecordBuffer& profile : this->profiles) profile.clear();
+        for (WorkerQueue& queue : this->queues) queue.resetContended();
+    }
+#endif
     int64_t getThreadCount() { return this->threadCount; }
     bool getActiveStatus() { return this->isActive; }
 };
+
+// One T per worker indexed by the threadId jobs get passed, each padded out to its own cache line
+template <typename T>
+class ThreadLocal {
+   private:
+    struct alignas(64) Slot {
+        T value;
+    };
+    std::vector<Slot> slots;
+
+   public:
+    ThreadLocal(ThreadPool& pool, const T& init) : slots(pool.getThreadCount(), Slot{init}) {}
+    T& operator[](int64_t threadId) { return this->slots[threadId].value; }
+    int64_t size() { return this->slots.size(); }
+    // Folds every worker's value together, leaves the slots moved-from
+    template <typename Combine>
+    T combine(Combine&& combine) {
+        T result = std::move(this->slots[0].value);
+        for (size_t i = 1; i < this->slots.size(); i++)
+            result = combine(std::move(result), std::move(this->slots[i].value));
+        return result;
+    }
+};
+
+// Fork-join on top of a JobGroup, run() forks and wait() joins. Waiting from inside a worker runs other
+// queued jobs instead of blocking, so jobs can split themselves recursively without running out of threads
+class TaskGroup {
+   private:
+    ThreadPool& pool;
+    JobGroup group;
+
+   public:
+    TaskGroup(ThreadPool& pool) : pool(pool) {}
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+    // the jobs reference the group, so it can't go away before they're done
+    ~TaskGroup() {
+        try {
+            this->wait();
+        } catch (...) {
+        }
+    }
+    // func() or func(threadId)
+    template <typename F>
+    void run(F&& func, PRIORITY priority = NORMAL_PRIORITY) {
+        if constexpr (std::is_invocable_v<std::decay_t<F>&, int64_t>) {
+            this->pool.addJob(std::forward<F>(func), this->group, priority);
+        } else {
+            this->pool.addJob(
+                [func = std::forward<F>(func)](int64_t threadId) mutable {
+                    (void)threadId;
+                    func();
+                },
+                this->group, priority);
+        }
+    }
+    void wait() {
+        this->pool.start();
+        this->pool.wait(this->group);
+    }
+    void cancel() { this->group.cancel(); }
+    bool isCancelled() const { return this->group.isCancelled(); }
+};
 }  // namespace ThreadPool
@@ -1,45 +1,136 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
 #include <cmath>
-#include <set>
+#include <cstdint>
 #include <vector>
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "thread_pool.hpp"
+
 // https://www.youtube.com/watch?v=_MscGSN5J6o
 // https://en.wikipedia.org/wiki/Miller%E2%80%93Rabin_primality_test
 namespace Witness {
-std::set<int64_t> primeSieve(int64_t max_val) {
-    std::set<int64_t> primeSet;
-    std::vector<bool> primeBit(max_val, false);
-    int64_t i = 2;
-    int64_t i_end = std::sqrt(max_val);
-    while (i < i_end) {
-        if (!primeBit[i]) {
-            primeSet.insert(i);
-            for (int64_t j = i * i; j < max_val; j += i) primeBit[j] = true;
-        }
-        i++;
+// __extension__ keeps -Wpedantic quiet about the non standard type
+__extension__ typedef unsigned __int128 u128;
+
+// bit k of a segment is the odd number 2 * (first + k) + 1, 2^18 bits is 32 KiB so a segment stays in L1
+const int64_t segment_bits = 1 << 18;
+
+// odd primes below limit, only used for the primes up to sqrt(max_val)
+std::vector<int64_t> oddPrimes(int64_t limit) {
+    std::vector<bool> composite(limit, false);
+    std::vector<int64_t> primes;
+    for (int64_t i = 3; i < limit; i += 2) {
+        if (composite[i]) continue;
+        primes.push_back(i);
+        for (int64_t j = i * i; j < limit; j += 2 * i) composite[j] = true;
+    }
+    return primes;
+}
+
+// Sieves the odd numbers below max_val one segment per job, visit(first, bits) gets called on a worker with
+// every segment (a set bit is a prime). Only sqrt(max_val) worth of primes and one segment per job are held,
+// so the range itself never has to fit in memory
+template <typename Visit>
+void sieveSegments(int64_t max_val, ThreadPool::ThreadPool& pool, Visit&& visit) {
+    int64_t odd_count = max_val / 2;
+    int64_t root = std::sqrt((double)max_val);
+    while (root * root > max_val) root--;
+    while ((root + 1) * (root + 1) <= max_val) root++;
+    const std::vector<int64_t> primes = oddPrimes(root + 1);
+    pool.parallel_for(
+        0, (odd_count + segment_bits - 1) / segment_bits, 1,
+        [&primes, &visit, odd_count](int64_t segment) {
+            int64_t first = segment * segment_bits;
+            int64_t count = std::min(segment_bits, odd_count - first);
+            std::vector<uint64_t> bits((count + 63) / 64, ~(uint64_t)0);
+            if (count % 64) bits.back() = ((uint64_t)1 << (count % 64)) - 1;
+            // 1 isn't prime
+            if (first == 0) bits[0] &= ~(uint64_t)1;
+            for (int64_t p : primes) {
+                // odd multiples of p are p apart in index, start from p * p or the first one in the segment
+                int64_t k = p * p / 2;
+                if (k >= first + count) break;
+                if (k < first) {
+                    int64_t m = (2 * first + 1 + p - 1) / p;
+                    k = (m | 1) * p / 2;
+                }
+                for (k -= first; k < count; k += p) bits[k >> 6] &= ~((uint64_t)1 << (k & 63));
+            }
+            visit(first, bits);
+        },
+        ThreadPool::STATIC_PARTITION);
+}
+
+// Primes below max_val, one bit per odd number so isPrime is a shift and a mask
+class PrimeBits {
+   private:
+    int64_t max_val;
+    std::vector<uint64_t> bits;
+
+   public:
+    PrimeBits(int64_t max_val, ThreadPool::ThreadPool& pool) : max_val(max_val), bits((max_val / 2 + 63) / 64, 0) {
+        // segments are whole words so no two jobs touch the same one
+        sieveSegments(max_val, pool, [this](int64_t first, const std::vector<uint64_t>& segment) {
+            std::copy(segment.begin(), segment.end(), bits.begin() + first / 64);
+        });
+    }
+    bool isPrime(int64_t i) const {
+        if (i < 2 || i >= max_val) return false;
+        if (i % 2 == 0) return i == 2;
+        return (bits[i / 2 / 64] >> (i / 2 % 64)) & 1;
+    }
+    int64_t count() const {
+        int64_t total = max_val > 2;
+        for (uint64_t word : bits) total += std::popcount(word);
+        return total;
     }
-    while (i < max_val) {
-        if (!primeBit[i]) primeSet.insert(i);
-        i++;
+    // sorted
+    std::vector<int64_t> toVector() const {
+        std::vector<int64_t> primes;
+        primes.reserve(count());
+        if (max_val > 2) primes.push_back(2);
+        for (size_t w = 0; w < bits.size(); w++)
+            for (uint64_t word = bits[w]; word; word &= word - 1)
+                primes.push_back(2 * (64 * w + std::countr_zero(word)) + 1);
+        return primes;
     }
-    return primeSet;
+};
+
+PrimeBits primeSieve(int64_t max_val, ThreadPool::ThreadPool& pool) { return PrimeBits(max_val, pool); }
+
+// The number of primes below max_val without keeping any of them, fine for 10^10 and past
+int64_t primeCount(int64_t max_val, ThreadPool::ThreadPool& pool) {
+    std::atomic<int64_t> total{max_val > 2};
+    sieveSegments(max_val, pool, [&total](int64_t first, const std::vector<uint64_t>& segment) {
+        (void)first;
+        int64_t count = 0;
+        for (uint64_t word : segment) count += std::popcount(word);
+        total += count;
+    });
+    return total;
 }
 
 // https://www.youtube.com/watch?v=cbGB__V8MNk
 // https://en.wikipedia.org/wiki/Exponentiation_by_squaring
 int64_t powerMod(int64_t x, int64_t n, int64_t mod_val) {
-    // assume n > 0
+    // assume n > 0, the products go through 128 bits so any mod_val up to 2^63 works
     int64_t y = 1;
     while (n > 1) {
         if (n % 2 == 1) {
-            y = (x * y) % mod_val;
+            y = (u128)x * y % mod_val;
             n--;
         }
-        x = (x * x) % mod_val;
+        x = (u128)x * x % mod_val;
         n /= 2;
     }
-    return (x * y) % mod_val;
+    return (u128)x * y % mod_val;
 }
 
 bool is_false_witness(int64_t a, int64_t s, int64_t d, int64_t n) {
@@ -47,13 +138,86 @@ bool is_false_witness(int64_t a, int64_t s, int64_t d, int64_t n) {
     if (y == 1 || y == n - 1) return true;
     int64_t r = 1;
     while (r < s) {
-        y = (y * y) % n;
+        y = (u128)y * y % n;
         if (y == n - 1) return true;
         r++;
     }
     return false;
 }
 
+// https://en.wikipedia.org/wiki/Montgomery_modular_multiplication
+// Residues mod an odd n < 2^63 kept as a * 2^64 mod n, so a multiply is two 64 bit products and a shift
+// instead of a 128 bit division. Setting up costs one division and is shared by every base of the same n
+class Montgomery {
+   private:
+    uint64_t n;
+    // -n^-1 mod 2^64
+    uint64_t n_neg_inv;
+    // 2^64 mod n, which is 1 in Montgomery form
+    uint64_t r1;
+    // 2^128 mod n, for converting in
+    uint64_t r2;
+
+   public:
+    Montgomery(uint64_t n) : n(n) {
+        // Newton's iteration doubles the correct low bits every step, n * n = 1 mod 8 gives the first 3
+        uint64_t inv = n;
+        for (int64_t i = 0; i < 5; i++) inv *= 2 - n * inv;
+        n_neg_inv = -inv;
+        r1 = -n % n;
+        r2 = (u128)r1 * r1 % n;
+    }
+    uint64_t modulus() const { return n; }
+    uint64_t reduce(u128 t) const {
+        uint64_t m = (uint64_t)t * n_neg_inv;
+        uint64_t result = (t + (u128)m * n) >> 64;
+        return result >= n ? result - n : result;
+    }
+    uint64_t multiply(uint64_t a, uint64_t b) const { return reduce((u128)a * b); }
+    uint64_t add(uint64_t a, uint64_t b) const {
+        uint64_t sum = a + b;
+        return sum >= n ? sum - n : sum;
+    }
+    uint64_t toMontgomery(uint64_t a) const { return multiply(a % n, r2); }
+    uint64_t fromMontgomery(uint64_t a) const { return reduce(a); }
+    uint64_t one() const { return r1; }
+    uint64_t minusOne() const { return n - r1; }
+    // count independent powers with the same exponent in lock step, so the multiplies of one don't
+    // have to wait on the latency of the others
+    template <int64_t count>
+    void powerBatch(uint64_t* x, uint64_t e) const {
+        uint64_t y[count];
+        for (int64_t l = 0; l < count; l++) y[l] = r1;
+        while (e > 0) {
+            if (e & 1)
+                for (int64_t l = 0; l < count; l++) y[l] = multiply(y[l], x[l]);
+            for (int64_t l = 0; l < count; l++) x[l] = multiply(x[l], x[l]);
+            e >>= 1;
+        }
+        for (int64_t l = 0; l < count; l++) x[l] = y[l];
+    }
+    uint64_t power(uint64_t x, uint64_t e) const {
+        uint64_t y = r1;
+        while (e > 0) {
+            if (e & 1) y = multiply(y, x);
+            x = multiply(x, x);
+            e >>= 1;
+        }
+        return y;
+    }
+};
+
+// a is already in Montgomery form
+bool is_false_witness(const Montgomery& mont, uint64_t a, int64_t s, uint64_t d) {
+    uint64_t y = mont.power(a, d);
+    if (y == mont.one() || y == mont.minusOne()) return true;
+    for (int64_t r = 1; r < s; r++) {
+        y = mont.multiply(y, y);
+        if (y == mont.minusOne()) return true;
+    }
+    return false;
+}
+
 int64_t remove_twos(int64_t& n) {
     int64_t s = 0;
     while (n % 2 == 0) {
@@ -63,11 +227,165 @@ int64_t remove_twos(int64_t& n) {
     return s;
 }
 
-void witness_count(std::vector<int64_t>& vect, int64_t n) {
+// Lanes of 64 bits each holding a 32 bit Montgomery residue, mul_epu32 only reads the low halves so a
+// product is one instruction. Without AVX2 a lane is just a uint64_t
+namespace Lanes {
+#if defined(__AVX512F__)
+typedef __m512i Vec;
+const int64_t width = 8;
+inline Vec set1(uint64_t a) { return _mm512_set1_epi64(a); }
+inline Vec load(const uint64_t* p) { return _mm512_loadu_si512(p); }
+// The zero masked forms with every lane enabled are the same instructions, the plain ones merge into
+// _mm512_undefined_epi32() which gcc before 12.3 flags as maybe-uninitialized (PR105593)
+inline Vec mul(Vec a, Vec b) { return _mm512_maskz_mul_epu32(0xFF, a, b); }
+// a + b or a * b / 2^32 can be up to 2n, u - n wraps when u < n which makes its low half bigger than u
+// and its high half all ones, so the 32 bit min picks u and otherwise picks u - n
+inline Vec reduce(Vec u, Vec n) { return _mm512_maskz_min_epu32(0xFFFF, u, _mm512_sub_epi64(u, n)); }
+inline Vec multiply(Vec a, Vec b, Vec n, Vec n_neg_inv) {
+    Vec t = mul(a, b);
+    Vec m = mul(t, n_neg_inv);
+    return reduce(_mm512_maskz_srli_epi64(0xFF, _mm512_add_epi64(t, mul(m, n)), 32), n);
+}
+inline uint64_t equal(Vec a, Vec b) { return _mm512_cmpeq_epi64_mask(a, b); }
+#elif defined(__AVX2__)
+typedef __m256i Vec;
+const int64_t width = 4;
+inline Vec set1(uint64_t a) { return _mm256_set1_epi64x(a); }
+inline Vec load(const uint64_t* p) { return _mm256_loadu_si256((const __m256i*)p); }
+inline Vec reduce(Vec u, Vec n) { return _mm256_min_epu32(u, _mm256_sub_epi64(u, n)); }
+inline Vec multiply(Vec a, Vec b, Vec n, Vec n_neg_inv) {
+    Vec t = _mm256_mul_epu32(a, b);
+    Vec m = _mm256_mul_epu32(t, n_neg_inv);
+    return reduce(_mm256_srli_epi64(_mm256_add_epi64(t, _mm256_mul_epu32(m, n)), 32), n);
+}
+inline uint64_t equal(Vec a, Vec b) { return _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(a, b))); }
+#else
+typedef uint64_t Vec;
+const int64_t width = 1;
+inline Vec set1(uint64_t a) { return a; }
+inline Vec load(const uint64_t* p) { return *p; }
+inline Vec reduce(Vec u, Vec n) { return std::min(u, u - n); }
+inline Vec multiply(Vec a, Vec b, Vec n, Vec n_neg_inv) {
+    Vec t = a * b;
+    Vec m = (uint32_t)((uint32_t)t * (uint32_t)n_neg_inv);
+    return reduce((t + m * n) >> 32, n);
+}
+inline uint64_t equal(Vec a, Vec b) { return a == b; }
+#endif
+}  // namespace Lanes
+
+// Montgomery with R = 2^32 for n < 2^31, small enough that t + m * n stays under 2^64, so every base
+// of a batch gets its own lane and the whole Miller-Rabin test runs on all of them at once
+class Montgomery32 {
+   private:
+    uint64_t n;
+    uint64_t n_neg_inv;
+    uint64_t r1;
+    uint64_t r2;
+
+   public:
+    Montgomery32(uint64_t n) : n(n) {
+        uint32_t inv = n;
+        for (int64_t i = 0; i < 4; i++) inv *= 2 - (uint32_t)n * inv;
+        n_neg_inv = (uint32_t)-inv;
+        r1 = ((uint64_t)1 << 32) % n;
+        r2 = r1 * r1 % n;
+    }
+    uint64_t multiply(uint64_t a, uint64_t b) const {
+        uint64_t t = a * b;
+        uint64_t m = (uint32_t)((uint32_t)t * (uint32_t)n_neg_inv);
+        uint64_t u = (t + m * n) >> 32;
+        return std::min(u, u - n);
+    }
+    uint64_t add(uint64_t a, uint64_t b) const { return std::min(a + b, a + b - n); }
+    uint64_t toMontgomery(uint64_t a) const { return multiply(a % n, r2); }
+    uint64_t fromMontgomery(uint64_t a) const { return multiply(a, 1); }
+    uint64_t one() const { return r1; }
+    // Miller-Rabin on bases a, a + 1 ... a + batch - 1 (a in Montgomery form), bit l of the result is set
+    // when n passes for base a + l. Every lane shares the bits of d so there's one squaring chain per
+    // vector and no branches, a comes back as the first base after the batch
+    template <int64_t batch>
+    uint64_t witnessMask(uint64_t& a, int64_t s, uint64_t d) const {
+        static_assert(batch % Lanes::width == 0 && batch <= 64, "batch has to be whole vectors");
+        const int64_t count = batch / Lanes::width;
+        const Lanes::Vec n_v = Lanes::set1(n), inv_v = Lanes::set1(n_neg_inv);
+        const Lanes::Vec one_v = Lanes::set1(r1), minus_one_v = Lanes::set1(n - r1);
+        uint64_t bases[batch];
+        for (int64_t l = 0; l < batch; l++) {
+            bases[l] = a;
+            a = add(a, r1);
+        }
+        Lanes::Vec x[count], y[count];
+        for (int64_t k = 0; k < count; k++) {
+            x[k] = Lanes::load(bases + k * Lanes::width);
+            y[k] = one_v;
+        }
+        while (d > 0) {
+            if (d & 1)
+                for (int64_t k = 0; k < count; k++) y[k] = Lanes::multiply(y[k], x[k], n_v, inv_v);
+            for (int64_t k = 0; k < count; k++) x[k] = Lanes::multiply(x[k], x[k], n_v, inv_v);
+            d >>= 1;
+        }
+        uint64_t mask = 0;
+        for (int64_t k = 0; k < count; k++)
+            mask |= (Lanes::equal(y[k], one_v) | Lanes::equal(y[k], minus_one_v)) << (k * Lanes::width);
+        // once a lane hits -1 it squares to 1 and stays there, so or-ing in the later -1s is enough
+        for (int64_t r = 1; r < s; r++) {
+            for (int64_t k = 0; k < count; k++) {
+                y[k] = Lanes::multiply(y[k], y[k], n_v, inv_v);
+                mask |= Lanes::equal(y[k], minus_one_v) << (k * Lanes::width);
+            }
+        }
+        return mask;
+    }
+};
+
+// Bases go 1, 2, 3 ... so the next one in Montgomery form is just the last one plus one(), they get
+// raised to d a few at a time with powerBatch
+void witness_count_wide(std::vector<int64_t>& vect, int64_t n) {
     // assume no out of bounds errors
+    const int64_t batch = 4;
     int64_t d = n - 1;
     int64_t s = remove_twos(d);
-    for (int64_t i = 1; i < n; i++)
+    Montgomery mont(n);
+    uint64_t a = mont.one();
+    int64_t i = 1;
+    for (; i + batch <= n; i += batch) {
+        uint64_t y[batch];
+        for (int64_t l = 0; l < batch; l++) {
+            y[l] = a;
+            a = mont.add(a, mont.one());
+        }
+        mont.powerBatch<batch>(y, d);
+        for (int64_t l = 0; l < batch; l++) {
+            bool witness = y[l] == mont.one() || y[l] == mont.minusOne();
+            for (int64_t r = 1; r < s && !witness; r++) {
+                y[l] = mont.multiply(y[l], y[l]);
+                witness = y[l] == mont.minusOne();
+            }
+            if (witness) vect[i + l]++;
+        }
+    }
+    for (; i < n; i++) {
+        if (is_false_witness(mont, a, s, d)) vect[i]++;
+        a = mont.add(a, mont.one());
+    }
+}
+
+// 16 bases at a time through witnessMask, n past 2^31 doesn't fit the 32 bit lanes and goes the wide way
+void witness_count(std::vector<int64_t>& vect, int64_t n) {
+    const int64_t batch = 16;
+    if (n >= ((int64_t)1 << 31)) return witness_count_wide(vect, n);
+    int64_t d = n - 1;
+    int64_t s = remove_twos(d);
+    Montgomery32 mont(n);
+    uint64_t a = mont.one();
+    int64_t i = 1;
+    for (; i + batch <= n; i += batch) {
+        uint64_t mask = mont.witnessMask<batch>(a, s, d);
+        for (int64_t l = 0; l < batch; l++) vect[i + l] += (mask >> l) & 1;
+    }
+    for (; i < n; i++)
         if (is_false_witness(i, s, d, n)) vect[i]++;
 }
 }  // namespace Witness
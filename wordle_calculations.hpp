@@ -1,20 +1,43 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <new>
+#include <ranges>
+#include <stdfloat>
 #include <string>
 #include <thread>
+#include <utility>
 #include <vector>
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
 #include "thread_pool.hpp"
 
 // lost in time forever
 namespace Wordle {
 const int64_t word_length = 5;
 
+const int64_t pattern_count = 243;
+
+// getGuessScores and getTreeCost score guesses * candidates pairs below this on the calling thread, a few
+// hundred candidates is faster to do there than to wake up the pool for
+const int64_t serial_score_pairs = (int64_t)1 << 24;
+
 enum FILTER_STATE { INVALID_SPOT, WRONG_SPOT, CORRECT_SPOT, NO_SPOT };
 
+using Word = std::array<char, word_length>;
+
 std::vector<std::string> parseWords(const std::string& filename, size_t expected_count) {
     std::vector<std::string> words;
     std::ifstream file(filename);
@@ -106,57 +129,479 @@ int64_t filterWordsCounter(const std::vector<std::string>& valid_words, const st
     return counter;
 }
 
+Word toWord(const std::string& str) {
+    assert(str.size() == word_length);
+    Word word;
+    for (int64_t i = 0; i < word_length; i++) word[i] = str[i];
+    return word;
+}
+
+std::vector<Word> toWords(const std::vector<std::string>& strs) {
+    std::vector<Word> words(strs.size());
+    for (size_t i = 0; i < strs.size(); i++) words[i] = toWord(strs[i]);
+    return words;
+}
+
+// Same thing as getFilterState packed into base 3, position 0 is the lowest digit
+// 0 is NO_SPOT, 1 is WRONG_SPOT and 2 is CORRECT_SPOT so every pattern fits in 0..242
+uint8_t getPattern(const Word& real_word, const Word& guess_word) {
+    Word real_word_mutate = real_word;
+    uint8_t digits[word_length] = {};
+    for (int64_t i = 0; i < word_length; i++) {
+        if (real_word[i] == guess_word[i]) {
+            digits[i] = 2;
+            real_word_mutate[i] = '_';
+        }
+    }
+    for (int64_t i = 0; i < word_length; i++) {
+        if (digits[i] == 2) continue;
+        for (int64_t j = 0; j < word_length; j++) {
+            if (real_word_mutate[j] != guess_word[i]) continue;
+            digits[i] = 1;
+            real_word_mutate[j] = '_';
+            break;
+        }
+    }
+    uint8_t pattern = 0;
+    for (int64_t i = word_length; i > 0; i--) pattern = pattern * 3 + digits[i - 1];
+    return pattern;
+}
+
+uint8_t encodeFilterState(const std::vector<FILTER_STATE>& filter_state) {
+    uint8_t pattern = 0;
+    for (int64_t i = word_length; i > 0; i--) {
+        assert(filter_state[i - 1] != INVALID_SPOT);
+        uint8_t digit = filter_state[i - 1] == CORRECT_SPOT ? 2 : filter_state[i - 1] == WRONG_SPOT ? 1 : 0;
+        pattern = pattern * 3 + digit;
+    }
+    return pattern;
+}
+
+std::vector<FILTER_STATE> decodePattern(uint8_t pattern) {
+    std::vector<FILTER_STATE> filter_state(word_length);
+    for (int64_t i = 0; i < word_length; i++, pattern /= 3) {
+        uint8_t digit = pattern % 3;
+        filter_state[i] = digit == 2 ? CORRECT_SPOT : digit == 1 ? WRONG_SPOT : NO_SPOT;
+    }
+    return filter_state;
+}
+
+// Five contiguous letter columns, padded with zeros out to a whole kernel block
+class WordStore {
+   private:
+    int64_t word_count;
+    int64_t padded_count;
+    std::vector<uint8_t> letters;
+
+   public:
+    static constexpr int64_t block_size = 64;
+
+    WordStore(const std::vector<Word>& words)
+        : word_count(words.size()),
+          padded_count((word_count + block_size - 1) / block_size * block_size),
+          letters(word_length * padded_count, 0) {
+        for (int64_t j = 0; j < word_count; j++)
+            for (int64_t k = 0; k < word_length; k++) letters[k * padded_count + j] = words[j][k];
+    }
+    WordStore(const std::vector<std::string>& words) : WordStore(toWords(words)) {}
+    const uint8_t* column(int64_t k) const { return letters.data() + k * padded_count; }
+    int64_t size() const { return word_count; }
+};
+
+// Patterns for one guess against answers [start, start + block_size), works the same way as getPattern:
+// a letter that isn't green is yellow when the answer has more non-green copies of it than earlier
+// non-green spots in the guess have already taken
+void getPatternBlock(const WordStore& answers, int64_t start, const Word& guess_word, uint8_t* out) {
+    const uint8_t weights[word_length] = {1, 3, 9, 27, 81};
+#if defined(__AVX512BW__)
+    __m512i letters[word_length];
+    __mmask64 green[word_length];
+    for (int64_t k = 0; k < word_length; k++) {
+        letters[k] = _mm512_loadu_si512(answers.column(k) + start);
+        green[k] = _mm512_cmpeq_epi8_mask(letters[k], _mm512_set1_epi8(guess_word[k]));
+    }
+    const __m512i one = _mm512_set1_epi8(1);
+    __m512i pattern = _mm512_setzero_si512();
+    for (int64_t i = 0; i < word_length; i++) {
+        __m512i guess_letter = _mm512_set1_epi8(guess_word[i]);
+        __m512i available = _mm512_setzero_si512();
+        __m512i taken = _mm512_setzero_si512();
+        for (int64_t k = 0; k < word_length; k++) {
+            __mmask64 match = _mm512_cmpeq_epi8_mask(letters[k], guess_letter) & ~green[k];
+            available = _mm512_mask_add_epi8(available, match, available, one);
+        }
+        for (int64_t j = 0; j < i; j++)
+            if (guess_word[j] == guess_word[i]) taken = _mm512_mask_add_epi8(taken, ~green[j], taken, one);
+        __mmask64 yellow = _mm512_cmpgt_epi8_mask(available, taken) & ~green[i];
+        pattern = _mm512_mask_add_epi8(pattern, green[i], pattern, _mm512_set1_epi8(2 * weights[i]));
+        pattern = _mm512_mask_add_epi8(pattern, yellow, pattern, _mm512_set1_epi8(weights[i]));
+    }
+    _mm512_storeu_si512(out, pattern);
+#elif defined(__AVX2__)
+    for (int64_t half = 0; half < WordStore::block_size; half += 32) {
+        __m256i letters[word_length];
+        __m256i not_green[word_length];
+        const __m256i ones = _mm256_set1_epi8(-1);
+        for (int64_t k = 0; k < word_length; k++) {
+            letters[k] = _mm256_loadu_si256((const __m256i*)(answers.column(k) + start + half));
+            __m256i green = _mm256_cmpeq_epi8(letters[k], _mm256_set1_epi8(guess_word[k]));
+            not_green[k] = _mm256_xor_si256(green, ones);
+        }
+        __m256i pattern = _mm256_setzero_si256();
+        for (int64_t i = 0; i < word_length; i++) {
+            __m256i guess_letter = _mm256_set1_epi8(guess_word[i]);
+            __m256i available = _mm256_setzero_si256();
+            __m256i taken = _mm256_setzero_si256();
+            // masks are -1 so subtracting them counts
+            for (int64_t k = 0; k < word_length; k++) {
+                __m256i match = _mm256_and_si256(_mm256_cmpeq_epi8(letters[k], guess_letter), not_green[k]);
+                available = _mm256_sub_epi8(available, match);
+            }
+            for (int64_t j = 0; j < i; j++)
+                if (guess_word[j] == guess_word[i]) taken = _mm256_sub_epi8(taken, not_green[j]);
+            __m256i yellow = _mm256_and_si256(_mm256_cmpgt_epi8(available, taken), not_green[i]);
+            __m256i digit = _mm256_andnot_si256(not_green[i], _mm256_set1_epi8(2 * weights[i]));
+            digit = _mm256_or_si256(digit, _mm256_and_si256(yellow, _mm256_set1_epi8(weights[i])));
+            pattern = _mm256_add_epi8(pattern, digit);
+        }
+        _mm256_storeu_si256((__m256i*)(out + half), pattern);
+    }
+#else
+    (void)weights;
+    for (int64_t j = 0; j < WordStore::block_size; j++) {
+        Word answer;
+        for (int64_t k = 0; k < word_length; k++) answer[k] = answers.column(k)[start + j];
+        out[j] = getPattern(answer, guess_word);
+    }
+#endif
+}
+
+void getPatterns(const WordStore& answers, const Word& guess_word, uint8_t* out) {
+    alignas(64) uint8_t block[WordStore::block_size];
+    int64_t start = 0;
+    for (; start + WordStore::block_size <= answers.size(); start += WordStore::block_size)
+        getPatternBlock(answers, start, guess_word, out + start);
+    if (start == answers.size()) return;
+    getPatternBlock(answers, start, guess_word, block);
+    std::memcpy(out + start, block, answers.size() - start);
+}
+
+// How many answers give this pattern for the guess, same as filterWordsCounter
+int64_t countPattern(const WordStore& answers, const Word& guess_word, uint8_t pattern) {
+    alignas(64) uint8_t block[WordStore::block_size];
+    int64_t count = 0;
+    for (int64_t start = 0; start < answers.size(); start += WordStore::block_size) {
+        getPatternBlock(answers, start, guess_word, block);
+        int64_t end = std::min(WordStore::block_size, answers.size() - start);
+        for (int64_t j = 0; j < end; j++) count += block[j] == pattern;
+    }
+    return count;
+}
+
+// patterns[guess][answer] for every pair, 14855 x 14855 is about 220 MB
+class PatternMatrix {
+   private:
+    int64_t guess_count;
+    int64_t answer_count;
+    std::vector<uint8_t> patterns;
+
+   public:
+    PatternMatrix(const std::vector<std::string>& guess_words, const std::vector<std::string>& answer_words,
+                  ThreadPool::ThreadPool& pool)
+        : guess_count(guess_words.size()), answer_count(answer_words.size()), patterns(guess_count * answer_count) {
+        auto guesses = toWords(guess_words);
+        WordStore answers(answer_words);
+        pool.parallel_for(0, guess_count, 16, [this, &guesses, &answers](int64_t i) {
+            getPatterns(answers, guesses[i], this->patterns.data() + i * this->answer_count);
+        });
+    }
+    uint8_t get(int64_t guess, int64_t answer) const { return patterns[guess * answer_count + answer]; }
+    const uint8_t* row(int64_t guess) const { return patterns.data() + guess * answer_count; }
+    int64_t guessCount() const { return guess_count; }
+    int64_t answerCount() const { return answer_count; }
+};
+
+// One bit per word index, a guess only ever clears bits
+class CandidateSet {
+   private:
+    int64_t word_count;
+    std::vector<uint64_t> bits;
+
+   public:
+    CandidateSet(int64_t word_count) : word_count(word_count), bits((word_count + 63) / 64, ~(uint64_t)0) {
+        if (word_count % 64 != 0) bits.back() = ((uint64_t)1 << (word_count % 64)) - 1;
+    }
+    // patterns holds the guess's pattern for every word, like a PatternMatrix row
+    void narrow(const uint8_t* patterns, uint8_t pattern) {
+        for (size_t b = 0; b < bits.size(); b++) {
+            if (bits[b] == 0) continue;
+            int64_t end = std::min((int64_t)64, word_count - (int64_t)b * 64);
+            uint64_t mask = 0;
+            for (int64_t k = 0; k < end; k++) mask |= (uint64_t)(patterns[b * 64 + k] == pattern) << k;
+            bits[b] &= mask;
+        }
+    }
+    bool contains(int64_t j) const { return (bits[j / 64] >> (j % 64)) & 1; }
+    int64_t count() const {
+        int64_t total = 0;
+        for (uint64_t block : bits) total += std::popcount(block);
+        return total;
+    }
+    std::vector<int64_t> indices() const {
+        std::vector<int64_t> result;
+        result.reserve(count());
+        for (size_t b = 0; b < bits.size(); b++)
+            for (uint64_t block = bits[b]; block != 0; block &= block - 1)
+                result.push_back(b * 64 + std::countr_zero(block));
+        return result;
+    }
+};
+
+void addGuessDistribution(const WordStore& valid_words, const std::vector<Word>& guess_words, const Word& real_word,
+                          std::vector<int64_t>& dist) {
+    for (size_t i = 0; i < guess_words.size(); i++)
+        dist[i] += countPattern(valid_words, guess_words[i], getPattern(real_word, guess_words[i]));
+}
+
+void addGuessDistribution(const std::vector<std::string>& valid_words, const std::vector<std::string>& guess_words,
+                          const std::string& real_word, std::vector<int64_t>& dist) {
+    addGuessDistribution(WordStore(valid_words), toWords(guess_words), toWord(real_word), dist);
+}
+
 std::vector<int64_t> getGuessDistribution(const std::vector<std::string>& valid_words,
                                           const std::vector<std::string>& guess_words, const std::string& real_word) {
-    std::vector<int64_t> dist;
-    dist.reserve(guess_words.size());
-    for (const std::string& guess : guess_words) {
-        auto filter = getFilterState(real_word, guess);
-        auto count = filterWordsCounter(valid_words, guess, filter);
-        dist.push_back(count);
-    }
+    std::vector<int64_t> dist(guess_words.size(), 0);
+    addGuessDistribution(valid_words, guess_words, real_word, dist);
     return dist;
 }
 
 std::vector<int64_t> getWordDistribution(const std::vector<std::string>& valid_words,
                                          const std::vector<std::string>& guess_words, ThreadPool::ThreadPool& pool) {
-    std::mutex addLock;
-    std::vector<int64_t> guess_dist(guess_words.size(), 0);
-    for (const std::string& word : valid_words) {
-        pool.addJob([&valid_words, &guess_words, &addLock, &guess_dist, &word](int64_t threadId) {
-            (void)threadId;
-            auto dist = getGuessDistribution(valid_words, guess_words, word);
-            std::unique_lock<std::mutex> lock(addLock);
-            for (size_t i = 0; i < guess_words.size(); i++) guess_dist[i] += dist[i];
-        });
+    WordStore valid_store(valid_words);
+    auto valid = toWords(valid_words);
+    auto guesses = toWords(guess_words);
+    ThreadPool::ThreadLocal<std::vector<int64_t>> guess_dist(pool, std::vector<int64_t>(guess_words.size(), 0));
+    pool.parallel_for(0, valid.size(), 1, [&valid_store, &valid, &guesses, &guess_dist](int64_t j, int64_t threadId) {
+        addGuessDistribution(valid_store, guesses, valid[j], guess_dist[threadId]);
+    });
+    return guess_dist.combine([](std::vector<int64_t> total, const std::vector<int64_t>& dist) {
+        for (size_t i = 0; i < total.size(); i++) total[i] += dist[i];
+        return total;
+    });
+}
+
+// For a guess the answers split into buckets by pattern and every answer in a bucket leaves the whole bucket,
+// so the getWordDistribution value is just the sum of the squared bucket sizes
+struct GuessScore {
+    int64_t score;
+    std::float64_t expected_remaining;
+    std::float64_t entropy;
+};
+
+GuessScore scoreHistogram(const int64_t* counts, int64_t answer_count) {
+    using std::float64_t;
+    GuessScore guess_score{0, 0, 0};
+    if (answer_count == 0) return guess_score;
+    for (int64_t k = 0; k < pattern_count; k++) {
+        if (counts[k] == 0) continue;
+        guess_score.score += counts[k] * counts[k];
+        float64_t p = counts[k] / (float64_t)answer_count;
+        guess_score.entropy -= p * std::log2(p);
     }
-    pool.start();
-    pool.wait(std::cout);
-    return guess_dist;
-}
-
-std::vector<std::vector<int64_t>> getWordMatrix(const std::vector<std::string>& valid_words,
-                                                const std::vector<std::string>& guess_words,
-                                                ThreadPool::ThreadPool& pool) {
-    std::mutex addLock;
-    std::vector<std::vector<int64_t>> guess_matrix(guess_words.size(), std::vector<int64_t>(valid_words.size(), -1));
-    for (size_t j = 0; j < valid_words.size(); j++) {
-        const std::string& word = valid_words[j];
-        pool.addJob([&valid_words, &guess_words, &addLock, &guess_matrix, &word, j](int64_t threadId) {
+    guess_score.expected_remaining = guess_score.score / (float64_t)answer_count;
+    return guess_score;
+}
+
+std::vector<GuessScore> getGuessScores(const std::vector<std::string>& valid_words,
+                                       const std::vector<std::string>& guess_words, ThreadPool::ThreadPool& pool) {
+    WordStore answers(valid_words);
+    auto guesses = toWords(guess_words);
+    std::vector<GuessScore> scores(guesses.size());
+    ThreadPool::ThreadLocal<std::vector<uint8_t>> rows(pool, std::vector<uint8_t>(answers.size()));
+    pool.parallel_for(0, guesses.size(), 16, [&answers, &guesses, &scores, &rows](int64_t i, int64_t threadId) {
+        std::vector<uint8_t>& row = rows[threadId];
+        getPatterns(answers, guesses[i], row.data());
+        int64_t counts[pattern_count] = {};
+        for (uint8_t pattern : row) counts[pattern]++;
+        scores[i] = scoreHistogram(counts, answers.size());
+    });
+    return scores;
+}
+
+GuessScore scoreGuess(const PatternMatrix& patterns, const std::vector<int64_t>& valid_indices, int64_t guess) {
+    const uint8_t* row = patterns.row(guess);
+    int64_t counts[pattern_count] = {};
+    for (int64_t j : valid_indices) counts[row[j]]++;
+    return scoreHistogram(counts, valid_indices.size());
+}
+
+std::vector<GuessScore> getGuessScores(const PatternMatrix& patterns, const std::vector<int64_t>& valid_indices,
+                                       ThreadPool::ThreadPool& pool) {
+    std::vector<GuessScore> scores(patterns.guessCount());
+    auto scoreRow = [&patterns, &valid_indices, &scores](int64_t i) {
+        scores[i] = scoreGuess(patterns, valid_indices, i);
+    };
+    if ((int64_t)valid_indices.size() * patterns.guessCount() < serial_score_pairs) {
+        for (int64_t i = 0; i < patterns.guessCount(); i++) scoreRow(i);
+        return scores;
+    }
+    pool.parallel_for(0, patterns.guessCount(), 16, scoreRow);
+    return scores;
+}
+
+// getGuessScores that returns straight away, scores is filled in by jobs in group and is only complete after
+// pool.wait(group). Every job checks the group between guesses so a cancelled round stops early,
+// valid_indices and scores have to stay alive until the group is done
+void addGuessScores(const PatternMatrix& patterns, const std::vector<int64_t>& valid_indices,
+                    std::vector<GuessScore>& scores, ThreadPool::ThreadPool& pool, ThreadPool::JobGroup& group,
+                    ThreadPool::PRIORITY priority = ThreadPool::NORMAL_PRIORITY) {
+    const int64_t grain = 64;
+    int64_t guess_count = patterns.guessCount();
+    scores.assign(guess_count, GuessScore{0, 0, 0});
+    auto chunks = std::views::iota((int64_t)0, (guess_count + grain - 1) / grain);
+    auto chunk_job = [&patterns, &valid_indices, &scores, &group, guess_count](int64_t chunk) {
+        return [&patterns, &valid_indices, &scores, &group, guess_count, chunk](int64_t threadId) {
             (void)threadId;
-            auto dist = getGuessDistribution(valid_words, guess_words, word);
-            std::unique_lock<std::mutex> lock(addLock);
-            for (size_t i = 0; i < guess_words.size(); i++) {
-                assert(guess_matrix[i][j] == -1);
-                guess_matrix[i][j] = dist[i];
-            }
+            int64_t end = std::min(guess_count, (chunk + 1) * grain);
+            for (int64_t i = chunk * grain; i < end && !group.isCancelled(); i++)
+                scores[i] = scoreGuess(patterns, valid_indices, i);
+        };
+    };
+    pool.addJobs(chunks | std::views::transform(chunk_job), group, priority);
+    pool.start();
+}
+
+std::vector<int64_t> getScoreValues(const std::vector<GuessScore>& scores) {
+    std::vector<int64_t> values(scores.size());
+    for (size_t i = 0; i < scores.size(); i++) values[i] = scores[i].score;
+    return values;
+}
+
+// getWordDistribution over the answers in valid_indices for every guess row of the matrix
+std::vector<int64_t> getWordDistribution(const PatternMatrix& patterns, const std::vector<int64_t>& valid_indices,
+                                         ThreadPool::ThreadPool& pool) {
+    return getScoreValues(getGuessScores(patterns, valid_indices, pool));
+}
+
+// Total guesses it takes to solve every answer in valid_indices if the lowest scoring guess is always played,
+// guess i and answer i have to be the same word so a guess that can still win gets picked on ties.
+// Every pattern bucket of the guess is solved as its own forked task, and big buckets get scored with a
+// nested parallel_for, both of which are fine from inside a job
+int64_t getTreeCost(const PatternMatrix& patterns, const std::vector<int64_t>& valid_indices,
+                    ThreadPool::ThreadPool& pool, int64_t depth = 1) {
+    if (valid_indices.size() == 1) return depth;
+    // just the getWordDistribution value, which is all that's needed to pick a guess
+    auto score_guess = [&patterns, &valid_indices](int64_t i) {
+        const uint8_t* row = patterns.row(i);
+        int32_t counts[pattern_count] = {};
+        int64_t score = 0;
+        for (int64_t j : valid_indices) score += 2 * counts[row[j]]++ + 1;
+        return score;
+    };
+    using Choice = std::pair<int64_t, int64_t>;
+    Choice best{INT64_MAX, 0};
+    // nothing beats a candidate that splits the rest into singletons, which is common once buckets get small
+    int64_t perfect_score = valid_indices.size();
+    for (int64_t j : valid_indices) {
+        if (score_guess(j) != perfect_score) continue;
+        best = Choice{perfect_score, j};
+        break;
+    }
+    if (best.first != perfect_score) {
+        if ((int64_t)valid_indices.size() * patterns.guessCount() < serial_score_pairs) {
+            for (int64_t i = 0; i < patterns.guessCount(); i++) best = std::min(best, Choice{score_guess(i), i});
+        } else {
+            best = pool.parallel_reduce(
+                0, patterns.guessCount(), best, [&score_guess](int64_t i) { return Choice{score_guess(i), i}; },
+                [](Choice a, Choice b) { return std::min(a, b); }, 16);
+        }
+        for (int64_t j : valid_indices) {
+            if (score_guess(j) != best.first) continue;
+            best.second = j;
+            break;
+        }
+    }
+
+    std::vector<std::vector<int64_t>> buckets(pattern_count);
+    const uint8_t* row = patterns.row(best.second);
+    for (int64_t j : valid_indices) buckets[row[j]].push_back(j);
+    std::vector<int64_t> costs(pattern_count, 0);
+    ThreadPool::TaskGroup group(pool);
+    for (int64_t k = 0; k < pattern_count - 1; k++) {
+        if (buckets[k].empty()) continue;
+        group.run([&patterns, &buckets, &costs, &pool, depth, k]() {
+            costs[k] = getTreeCost(patterns, buckets[k], pool, depth + 1);
         });
     }
-    pool.start();
-    pool.wait(std::cout);
+    group.wait();
+    // the last pattern is all correct, the guess itself
+    int64_t cost = buckets[pattern_count - 1].size() * depth;
+    for (int64_t bucket_cost : costs) cost += bucket_cost;
+    return cost;
+}
 
-    for (size_t i = 0; i < guess_words.size(); i++)
-        for (size_t j = 0; j < valid_words.size(); j++) assert(guess_matrix[i][j] != -1);
+// Hands out storage starting on a cache line, plain std::allocator only promises alignof(T)
+template <typename T>
+struct CacheLineAllocator {
+    typedef T value_type;
+    CacheLineAllocator() = default;
+    template <typename U>
+    CacheLineAllocator(const CacheLineAllocator<U>&) {}
+    T* allocate(size_t n) { return (T*)::operator new(n * sizeof(T), std::align_val_t{64}); }
+    void deallocate(T* p, size_t) { ::operator delete(p, std::align_val_t{64}); }
+    bool operator==(const CacheLineAllocator&) const { return true; }
+};
+
+// Flat row-major storage, the stride is padded to a multiple of 64 bytes and the storage starts on a cache
+// line so every row starts on its own cache line
+template <typename T>
+class Matrix {
+   private:
+    int64_t row_count;
+    int64_t col_count;
+    int64_t stride;
+    std::vector<T, CacheLineAllocator<T>> values;
+
+   public:
+    Matrix(int64_t row_count, int64_t col_count)
+        : row_count(row_count),
+          col_count(col_count),
+          stride((col_count * sizeof(T) + 63) / 64 * 64 / sizeof(T)),
+          values(row_count * stride) {}
+    T& operator()(int64_t i, int64_t j) { return values[i * stride + j]; }
+    T operator()(int64_t i, int64_t j) const { return values[i * stride + j]; }
+    T* row(int64_t i) { return values.data() + i * stride; }
+    const T* row(int64_t i) const { return values.data() + i * stride; }
+    int64_t rows() const { return row_count; }
+    int64_t cols() const { return col_count; }
+};
+
+// guess_matrix(i, j) is how many valid words are left after guessing guess_words[i] when the answer is
+// valid_words[j], which is the size of the pattern bucket valid_words[j] lands in for that guess.
+// Each job owns whole rows so nothing is shared, validate spot checks some columns the slow way
+Matrix<uint16_t> getWordMatrix(const std::vector<std::string>& valid_words, const std::vector<std::string>& guess_words,
+                               ThreadPool::ThreadPool& pool, bool validate = false) {
+    assert(valid_words.size() <= UINT16_MAX);
+    WordStore answers(valid_words);
+    auto guesses = toWords(guess_words);
+    Matrix<uint16_t> guess_matrix(guesses.size(), answers.size());
+    ThreadPool::ThreadLocal<std::vector<uint8_t>> rows(pool, std::vector<uint8_t>(answers.size()));
+    pool.parallel_for(0, guesses.size(), 16, [&answers, &guesses, &guess_matrix, &rows](int64_t i, int64_t threadId) {
+        std::vector<uint8_t>& patterns = rows[threadId];
+        getPatterns(answers, guesses[i], patterns.data());
+        uint16_t counts[pattern_count] = {};
+        for (uint8_t pattern : patterns) counts[pattern]++;
+        uint16_t* row = guess_matrix.row(i);
+        for (int64_t j = 0; j < answers.size(); j++) row[j] = counts[patterns[j]];
+    });
+
+    if (validate) {
+        int64_t step = std::max((int64_t)1, answers.size() / 16);
+        for (int64_t j = 0; j < answers.size(); j += step) {
+            auto dist = getGuessDistribution(valid_words, guess_words, valid_words[j]);
+            for (size_t i = 0; i < guess_words.size(); i++) assert(guess_matrix(i, j) == dist[i]);
+        }
+    }
 
     return guess_matrix;
 }
@@ -1,12 +1,14 @@
 #include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <random>
 #include <tuple>
 #include <utility>
 
+#include "matrix_file.hpp"
 #include "wordle_calculations.hpp"
 
 int main(int argc, char const *argv[]) {
@@ -14,15 +16,24 @@ int main(int argc, char const *argv[]) {
     (void)argv;
 
     ThreadPool::ThreadPool pool;
+    pool.setPlacement(ThreadPool::ALL_CPUS);
     auto words = Wordle::parseWords("wordle-nyt-words-14855.txt", 14855);
     auto matrix = Wordle::getWordMatrix(words, words, pool);
+    for (int64_t i = 0; i < std::min(matrix.rows(), (int64_t)4); i++) assert((uintptr_t)matrix.row(i) % 64 == 0);
 
-    std::ofstream file("wordle_matrix.txt");
-    for (size_t i = 0; i < words.size(); i++) {
-        for (size_t j = 0; j < words.size(); j++) {
-            file << matrix[i][j] << " ";
+    MatrixFile::MatrixWriter<uint16_t> file("wordle_matrix.bin", matrix.rows(), matrix.cols(),
+                                            MatrixFile::wordsChecksum(words));
+    for (int64_t i = 0; i < matrix.rows(); i++) {
+        file.writeRow(matrix.row(i));
+        if (!file.good()) {
+            std::cerr << "writing row " << i << " of wordle_matrix.bin failed\n";
+            std::abort();
         }
-        file << "\n";
+    }
+    file.close();
+    if (!file.good()) {
+        std::cerr << "writing wordle_matrix.bin failed\n";
+        std::abort();
     }
 
     pool.stop();
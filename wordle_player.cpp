@@ -1,3 +1,6 @@
+#include <poll.h>
+#include <unistd.h>
+
 #include <algorithm>
 #include <cassert>
 #include <chrono>
@@ -8,6 +11,7 @@
 #include <tuple>
 #include <utility>
 
+#include "matrix_file.hpp"
 #include "wordle_calculations.hpp"
 
 std::vector<std::pair<std::string, int64_t>> sort_scores(const std::vector<std::string> &words,
@@ -56,29 +60,71 @@ void read_word(std::string &the_word, std::vector<Wordle::FILTER_STATE> &the_fil
     }
 }
 
+// True once the group is done, false if the next guess was typed in before it finished. Only a terminal
+// gets to interrupt, piped input always waits so every round gets printed
+bool wait_for_scores(ThreadPool::ThreadPool &pool, ThreadPool::JobGroup &group) {
+    if (isatty(STDIN_FILENO)) {
+        pollfd input{STDIN_FILENO, POLLIN, 0};
+        while (group.pending() > 0)
+            if (std::cin.rdbuf()->in_avail() > 0 || poll(&input, 1, 10) > 0) return false;
+    }
+    pool.wait(group);
+    return true;
+}
+
 int main(int argc, char const *argv[]) {
     (void)argc;
     (void)argv;
 
     ThreadPool::ThreadPool pool;
     auto all_words = Wordle::parseWords("wordle-nyt-words-14855.txt", 14855);
-    auto valid_words = all_words;
-    auto scores = Wordle::parseScores("wordle_scores.txt", 14855);
+    Wordle::WordStore store(all_words);
+    Wordle::PatternMatrix patterns(all_words, all_words, pool);
+    Wordle::CandidateSet candidates(all_words.size());
+    std::vector<uint8_t> guess_patterns(all_words.size());
+    std::vector<int64_t> scores;
+    MatrixFile::MappedMatrix<uint32_t> score_file("wordle_scores.bin");
+    if (score_file.matches(all_words) && score_file.rows() == all_words.size() && score_file.cols() == 1)
+        scores.assign(score_file.row(0), score_file.row(0) + score_file.rows());
+    else
+        scores = Wordle::parseScores("wordle_scores.txt", 14855);
     std::string the_word = "abcde";
     std::vector<Wordle::FILTER_STATE> the_filter(Wordle::word_length, Wordle::INVALID_SPOT);
     assert(the_word.size() == Wordle::word_length);
     assert(the_filter.size() == Wordle::word_length);
 
+    ThreadPool::JobGroup rescoring;
+    std::vector<int64_t> round_indices;
+    std::vector<Wordle::GuessScore> round_scores;
+    bool rescored = false;
     std::cout << all_words.size() << " words:\n";
-    while (valid_words.size() != 1) {
-        auto sorted_scores = sort_scores(all_words, scores);
-        print_scores(sorted_scores, valid_words.size());
+    while (candidates.count() != 1) {
+        if (wait_for_scores(pool, rescoring)) {
+            if (rescored) scores = Wordle::getScoreValues(round_scores);
+            print_scores(sort_scores(all_words, scores), candidates.count());
+        } else {
+            // the next guess is already here so this round's scores are stale
+            rescoring.cancel();
+            pool.wait(rescoring);
+        }
         read_word(the_word, the_filter);
-        valid_words = Wordle::filterWords(valid_words, the_word, the_filter);
-        std::cout << valid_words.size() << " words:\n";
-        scores = Wordle::getWordDistribution(valid_words, all_words, pool);
+        uint8_t pattern = Wordle::encodeFilterState(the_filter);
+        auto guess = std::find(all_words.begin(), all_words.end(), the_word);
+        if (guess != all_words.end()) {
+            candidates.narrow(patterns.row(guess - all_words.begin()), pattern);
+        } else {
+            Wordle::getPatterns(store, Wordle::toWord(the_word), guess_patterns.data());
+            candidates.narrow(guess_patterns.data(), pattern);
+        }
+        std::cout << candidates.count() << " words:\n";
+        rescoring.reset();
+        round_indices = candidates.indices();
+        Wordle::addGuessScores(patterns, round_indices, round_scores, pool, rescoring, ThreadPool::HIGH_PRIORITY);
+        rescored = true;
     }
-    std::cout << "The Word: " << valid_words[0] << "\n";
+    rescoring.cancel();
+    pool.wait(rescoring);
+    std::cout << "The Word: " << all_words[candidates.indices()[0]] << "\n";
 
     pool.stop();
 
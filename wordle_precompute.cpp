@@ -1,13 +1,16 @@
 #include <algorithm>
 #include <cassert>
 #include <chrono>
-#include <fstream>
+#include <cstdlib>
 #include <iostream>
+#include <numeric>
 #include <random>
 #include <stdfloat>
 #include <tuple>
 #include <utility>
 
+#include "matrix_file.hpp"
+#include "result_writer.hpp"
 #include "thread_pool.hpp"
 #include "wordle_calculations.hpp"
 
@@ -63,6 +66,24 @@ void test_code() {
     shuffle_array(words_all);
     std::vector<std::string> words(words_all.begin(), words_all.begin() + 100);
 
+    ThreadPool::ThreadPool pool;
+    auto slow_dist = Wordle::getWordDistribution(words, words, pool);
+    auto fast_dist = Wordle::getScoreValues(Wordle::getGuessScores(words, words, pool));
+    assert(slow_dist == fast_dist);
+
+    // every bucket of the tree is a forked task that waits on its own subtasks, so it has to come out the same
+    // on one thread as on all of them
+    std::vector<std::string> tree_words(words_all.begin(), words_all.begin() + 2000);
+    Wordle::PatternMatrix tree_patterns(tree_words, tree_words, pool);
+    std::vector<int64_t> tree_indices(tree_words.size());
+    std::iota(tree_indices.begin(), tree_indices.end(), 0);
+    ThreadPool::ThreadPool single_pool(1);
+    int64_t tree_cost = Wordle::getTreeCost(tree_patterns, tree_indices, pool);
+    assert(tree_cost == Wordle::getTreeCost(tree_patterns, tree_indices, single_pool));
+    assert(tree_cost >= (int64_t)tree_words.size());
+    single_pool.stop();
+    pool.stop();
+
     for (auto const &real_word : words) {
         for (auto const &test_word : words) {
             for (auto const &guess_word : words) {
@@ -75,6 +96,24 @@ void test_code() {
         }
     }
 
+    for (auto const &real_word : words) {
+        for (auto const &guess_word : words) {
+            auto filter = Wordle::getFilterState(real_word, guess_word);
+            uint8_t pattern = Wordle::getPattern(Wordle::toWord(real_word), Wordle::toWord(guess_word));
+            assert(pattern == Wordle::encodeFilterState(filter));
+            assert(Wordle::decodePattern(pattern) == filter);
+        }
+    }
+
+    Wordle::WordStore store_all(words_all);
+    std::vector<uint8_t> kernel_patterns(words_all.size());
+    for (auto const &guess_word : words) {
+        auto guess = Wordle::toWord(guess_word);
+        Wordle::getPatterns(store_all, guess, kernel_patterns.data());
+        for (size_t j = 0; j < words_all.size(); j++)
+            assert(kernel_patterns[j] == Wordle::getPattern(Wordle::toWord(words_all[j]), guess));
+    }
+
     shuffle_array(words);
 
     std::chrono::duration<int64_t, std::nano> filter_compare{0};
@@ -102,8 +141,25 @@ void test_code() {
     auto filter_time = std::chrono::duration_cast<std::chrono::microseconds>(filter_compare).count();
     auto custom_time = std::chrono::duration_cast<std::chrono::microseconds>(custom_compare).count() / 1000.0;
 
+    // the same pairs again, one getPatterns call covers every test_word
+    Wordle::WordStore store(words);
+    std::vector<uint8_t> row(words.size());
+    int64_t matches = 0;
+    auto time1 = std::chrono::steady_clock::now();
+    for (auto const &real_word : words) {
+        for (auto const &guess_word : words) {
+            auto guess = Wordle::toWord(guess_word);
+            uint8_t pattern = Wordle::getPattern(Wordle::toWord(real_word), guess);
+            Wordle::getPatterns(store, guess, row.data());
+            for (uint8_t test_pattern : row) matches += test_pattern == pattern;
+        }
+    }
+    auto time2 = std::chrono::steady_clock::now();
+    assert(matches > 0);
+    auto kernel_time = std::chrono::duration_cast<std::chrono::microseconds>(time2 - time1).count() / 1000.0;
+
     std::cout << "Filter Compare Time: " << filter_time / 1000.0 << " ms\nCustom Compare Time: " << custom_time
-              << " ms\n";
+              << " ms\nKernel Compare Time: " << kernel_time << " ms\n";
 }
 
 int main(int argc, char const *argv[]) {
@@ -116,20 +172,51 @@ int main(int argc, char const *argv[]) {
 
     ThreadPool::ThreadPool pool;
     auto words = Wordle::parseWords("wordle-nyt-words-14855.txt", 14855);
-    auto dist = Wordle::getWordDistribution(words, words, pool);
+    auto scores = Wordle::getGuessScores(words, words, pool);
+    auto dist = Wordle::getScoreValues(scores);
 
-    std::ofstream file("wordle_scores.txt");
-    for (int64_t score : dist) file << score << "\n";
+    ResultWriter::BufferedFile file("wordle_scores.txt");
+    for (int64_t score : dist) {
+        file.write(score);
+        file.put('\n');
+    }
+    file.close();
     assert(words.size() == dist.size());
 
+    // a score is at most words.size() squared
+    std::vector<uint32_t> narrow_dist(dist.begin(), dist.end());
+    if (!MatrixFile::writeMatrix("wordle_scores.bin", dist.size(), 1, narrow_dist.data(),
+                                 MatrixFile::wordsChecksum(words))) {
+        std::cerr << "writing wordle_scores.bin failed\n";
+        std::abort();
+    }
+
     std::vector<std::pair<std::string, int64_t>> vect(dist.size());
     for (size_t i = 0; i < dist.size(); i++) vect[i] = std::pair(words[i], dist[i]);
     std::sort(vect.begin(), vect.end(), [](auto &a, auto &b) { return b.second > a.second; });
 
-    std::ofstream file2("wordle_output.txt");
-    file2 << std::fixed << std::setprecision(3);
-    for (size_t i = 0; i < dist.size(); i++)
-        file2 << vect[i].first << " " << vect[i].second / (float64_t)dist.size() << "\n";
+    ResultWriter::BufferedFile file2("wordle_output.txt");
+    for (size_t i = 0; i < dist.size(); i++) {
+        file2.write(vect[i].first);
+        file2.put(' ');
+        file2.write(vect[i].second / (float64_t)dist.size(), 3);
+        file2.put('\n');
+    }
+    file2.close();
+
+    // only the best three get printed so they come out of a heap instead of a sort
+    auto more_entropy = [](const std::pair<std::string, float64_t> &a, const std::pair<std::string, float64_t> &b) {
+        return a.second > b.second;
+    };
+    ResultWriter::TopK<std::pair<std::string, float64_t>, decltype(more_entropy)> top_entropy(3, more_entropy);
+    for (size_t i = 0; i < scores.size(); i++) top_entropy.push(std::pair(words[i], scores[i].entropy));
+    auto entropy = top_entropy.sorted();
+
+    std::cout << std::fixed << std::setprecision(3);
+    for (size_t i = 0; i < 3; i++) {
+        std::cout << vect[i].first << " - " << vect[i].second / (float64_t)dist.size() << " expected remaining\n";
+    }
+    for (size_t i = 0; i < 3; i++) std::cout << entropy[i].first << " - " << entropy[i].second << " bits\n";
 
     pool.stop();
     return 0;